@@ -0,0 +1,383 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file blit_kernels.cpp Vectorized blitting of runs of 32bpp sprite pixels. */
+
+#include "stdafx.h"
+#include "blit_kernels.h"
+#include "palette.h"
+#include "math_func.h"
+#include <SDL.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	/** SSE2 kernels can be compiled. */
+	#define WITH_SSE2
+	#include <emmintrin.h>
+
+	#if defined(__GNUC__) || defined(_MSC_VER)
+		/** AVX2 kernels can be compiled (and are selected at runtime). */
+		#define WITH_AVX2
+		#include <immintrin.h>
+	#endif
+#endif
+
+#if defined(__GNUC__)
+	/** Compile a function for the AVX2 instruction set. */
+	#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define TARGET_AVX2
+#endif
+
+BlitKernels _blit_kernels = {"generic", nullptr, nullptr, nullptr}; ///< Selected kernels for blitting runs of pixels.
+
+/**
+ * Apply a gradient shift to a colour channel, like the #ShiftFunc functions do.
+ * @param col Colour channel value.
+ * @param shift Shift amount.
+ * @return Shifted colour channel value.
+ */
+static inline uint8 ShiftChannel(uint8 col, int shift)
+{
+	return Clamp(col + shift, 0, 255);
+}
+
+/**
+ * Blend a pixel with the existing pixel.
+ * @param colour New pixel, after applying the gradient shift.
+ * @param old_pixel Existing pixel.
+ * @param opacity Opacity of the new pixel.
+ * @return The blended pixel.
+ */
+static inline uint32 BlendPixel(uint32 colour, uint32 old_pixel, uint8 opacity)
+{
+	uint r = GetR(colour) * opacity + GetR(old_pixel) * (256 - opacity);
+	uint g = GetG(colour) * opacity + GetG(old_pixel) * (256 - opacity);
+	uint b = GetB(colour) * opacity + GetB(old_pixel) * (256 - opacity);
+	return MakeRGBA(r >> 8, g >> 8, b >> 8, OPAQUE);
+}
+
+#ifdef WITH_SSE2
+
+/**
+ * Make a pixel (without alpha) from red, green, and blue bytes.
+ * @param src Colour bytes.
+ * @return The pixel, with zero alpha.
+ */
+static inline int32 MakeRGB(const uint8 *src)
+{
+	return (int32)MakeRGBA(src[0], src[1], src[2], 0);
+}
+
+/**
+ * Apply the gradient shift to four pixels.
+ * @param pixels Pixels to shift.
+ * @param add Saturated amount to add to every byte.
+ * @param sub Saturated amount to subtract from every byte.
+ * @return Shifted pixels.
+ */
+static inline __m128i ShiftSSE2(__m128i pixels, __m128i add, __m128i sub)
+{
+	return _mm_subs_epu8(_mm_adds_epu8(pixels, add), sub);
+}
+
+/**
+ * Blend four pixels with four existing pixels.
+ * @param colour New pixels, after applying the gradient shift.
+ * @param old Existing pixels.
+ * @param opacity Opacity of the new pixels in every 16 bit lane.
+ * @param inverse Opacity of the existing pixels (\c 256 minus \a opacity) in every 16 bit lane.
+ * @return Blended pixels, with undefined alpha.
+ */
+static inline __m128i BlendSSE2(__m128i colour, __m128i old, __m128i opacity, __m128i inverse)
+{
+	const __m128i zero = _mm_setzero_si128();
+	/* Channels are at most 255, so the sum of both products always fits in 16 bits. */
+	__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(colour, zero), opacity), _mm_mullo_epi16(_mm_unpacklo_epi8(old, zero), inverse));
+	__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(colour, zero), opacity), _mm_mullo_epi16(_mm_unpackhi_epi8(old, zero), inverse));
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+/** SSE2 implementation of #BlitOpaqueKernel. */
+static void BlitOpaqueSSE2(uint32 *dest, const uint8 *src, int count, int shift)
+{
+	const __m128i add = _mm_set1_epi8(shift > 0 ? shift : 0);
+	const __m128i sub = _mm_set1_epi8(shift < 0 ? -shift : 0);
+	const __m128i alpha = _mm_set1_epi32(OPAQUE);
+	for (; count >= 4; count -= 4) {
+		__m128i pixels = _mm_setr_epi32(MakeRGB(src), MakeRGB(src + 3), MakeRGB(src + 6), MakeRGB(src + 9));
+		_mm_storeu_si128((__m128i *)dest, _mm_or_si128(ShiftSSE2(pixels, add, sub), alpha));
+		dest += 4;
+		src += 12;
+	}
+	for (; count > 0; count--) {
+		*dest++ = MakeRGBA(ShiftChannel(src[0], shift), ShiftChannel(src[1], shift), ShiftChannel(src[2], shift), OPAQUE);
+		src += 3;
+	}
+}
+
+/** SSE2 implementation of #BlitTranslucentKernel. */
+static void BlitTranslucentSSE2(uint32 *dest, const uint8 *src, int count, uint8 opacity, int shift)
+{
+	const __m128i add = _mm_set1_epi8(shift > 0 ? shift : 0);
+	const __m128i sub = _mm_set1_epi8(shift < 0 ? -shift : 0);
+	const __m128i alpha = _mm_set1_epi32(OPAQUE);
+	const __m128i opac = _mm_set1_epi16(opacity);
+	const __m128i inverse = _mm_set1_epi16(256 - opacity);
+	for (; count >= 4; count -= 4) {
+		__m128i pixels = _mm_setr_epi32(MakeRGB(src), MakeRGB(src + 3), MakeRGB(src + 6), MakeRGB(src + 9));
+		__m128i old = _mm_loadu_si128((const __m128i *)dest);
+		pixels = BlendSSE2(ShiftSSE2(pixels, add, sub), old, opac, inverse);
+		_mm_storeu_si128((__m128i *)dest, _mm_or_si128(pixels, alpha));
+		dest += 4;
+		src += 12;
+	}
+	for (; count > 0; count--) {
+		uint32 colour = MakeRGBA(ShiftChannel(src[0], shift), ShiftChannel(src[1], shift), ShiftChannel(src[2], shift), OPAQUE);
+		*dest = BlendPixel(colour, *dest, opacity);
+		dest++;
+		src += 3;
+	}
+}
+
+/** SSE2 implementation of #BlitRecolourKernel. */
+static void BlitRecolourSSE2(uint32 *dest, const uint8 *src, int count, const uint32 *table, uint8 opacity, int shift)
+{
+	const __m128i add = _mm_set1_epi8(shift > 0 ? shift : 0);
+	const __m128i sub = _mm_set1_epi8(shift < 0 ? -shift : 0);
+	const __m128i alpha = _mm_set1_epi32(OPAQUE);
+	const __m128i opac = _mm_set1_epi16(opacity);
+	const __m128i inverse = _mm_set1_epi16(256 - opacity);
+	for (; count >= 4; count -= 4) {
+		__m128i pixels = _mm_setr_epi32(table[src[0]], table[src[1]], table[src[2]], table[src[3]]);
+		__m128i old = _mm_loadu_si128((const __m128i *)dest);
+		pixels = BlendSSE2(ShiftSSE2(pixels, add, sub), old, opac, inverse);
+		_mm_storeu_si128((__m128i *)dest, _mm_or_si128(pixels, alpha));
+		dest += 4;
+		src += 4;
+	}
+	for (; count > 0; count--) {
+		uint32 recoloured = table[*src++];
+		uint32 colour = MakeRGBA(ShiftChannel(GetR(recoloured), shift), ShiftChannel(GetG(recoloured), shift), ShiftChannel(GetB(recoloured), shift), OPAQUE);
+		*dest = BlendPixel(colour, *dest, opacity);
+		dest++;
+	}
+}
+
+#endif /* WITH_SSE2 */
+
+#ifdef WITH_AVX2
+
+/**
+ * Load exactly 12 bytes (four pixels of red, green, and blue bytes).
+ * @param src Bytes to load.
+ * @return Loaded bytes in the lower 12 bytes.
+ */
+TARGET_AVX2 static inline __m128i Load12AVX2(const uint8 *src)
+{
+	int32 last;
+	memcpy(&last, src + 8, sizeof(last));
+	return _mm_insert_epi32(_mm_loadl_epi64((const __m128i *)src), last, 2);
+}
+
+/**
+ * Load eight pixels of red, green, and blue bytes, and convert them to pixels.
+ * @param src Colour bytes of the pixels.
+ * @return Pixels, with zero alpha.
+ */
+TARGET_AVX2 static inline __m256i LoadRGBAVX2(const uint8 *src)
+{
+	/* Every 32 bit pixel is A, B, G, R in memory; 0x80 clears the alpha byte. */
+	const __m256i expand = _mm256_setr_epi8(
+			-128, 2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9,
+			-128, 2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9);
+	__m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(Load12AVX2(src)), Load12AVX2(src + 12), 1);
+	return _mm256_shuffle_epi8(bytes, expand);
+}
+
+/**
+ * Blend eight pixels with eight existing pixels.
+ * @param colour New pixels, after applying the gradient shift.
+ * @param old Existing pixels.
+ * @param opacity Opacity of the new pixels in every 16 bit lane.
+ * @param inverse Opacity of the existing pixels (\c 256 minus \a opacity) in every 16 bit lane.
+ * @return Blended pixels, with undefined alpha.
+ */
+TARGET_AVX2 static inline __m256i BlendAVX2(__m256i colour, __m256i old, __m256i opacity, __m256i inverse)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(colour, zero), opacity), _mm256_mullo_epi16(_mm256_unpacklo_epi8(old, zero), inverse));
+	__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(colour, zero), opacity), _mm256_mullo_epi16(_mm256_unpackhi_epi8(old, zero), inverse));
+	return _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+}
+
+/** AVX2 implementation of #BlitOpaqueKernel. */
+TARGET_AVX2 static void BlitOpaqueAVX2(uint32 *dest, const uint8 *src, int count, int shift)
+{
+	const __m256i add = _mm256_set1_epi8(shift > 0 ? shift : 0);
+	const __m256i sub = _mm256_set1_epi8(shift < 0 ? -shift : 0);
+	const __m256i alpha = _mm256_set1_epi32(OPAQUE);
+	for (; count >= 8; count -= 8) {
+		__m256i pixels = _mm256_subs_epu8(_mm256_adds_epu8(LoadRGBAVX2(src), add), sub);
+		_mm256_storeu_si256((__m256i *)dest, _mm256_or_si256(pixels, alpha));
+		dest += 8;
+		src += 24;
+	}
+	for (; count > 0; count--) {
+		*dest++ = MakeRGBA(ShiftChannel(src[0], shift), ShiftChannel(src[1], shift), ShiftChannel(src[2], shift), OPAQUE);
+		src += 3;
+	}
+}
+
+/** AVX2 implementation of #BlitTranslucentKernel. */
+TARGET_AVX2 static void BlitTranslucentAVX2(uint32 *dest, const uint8 *src, int count, uint8 opacity, int shift)
+{
+	const __m256i add = _mm256_set1_epi8(shift > 0 ? shift : 0);
+	const __m256i sub = _mm256_set1_epi8(shift < 0 ? -shift : 0);
+	const __m256i alpha = _mm256_set1_epi32(OPAQUE);
+	const __m256i opac = _mm256_set1_epi16(opacity);
+	const __m256i inverse = _mm256_set1_epi16(256 - opacity);
+	for (; count >= 8; count -= 8) {
+		__m256i pixels = _mm256_subs_epu8(_mm256_adds_epu8(LoadRGBAVX2(src), add), sub);
+		__m256i old = _mm256_loadu_si256((const __m256i *)dest);
+		pixels = BlendAVX2(pixels, old, opac, inverse);
+		_mm256_storeu_si256((__m256i *)dest, _mm256_or_si256(pixels, alpha));
+		dest += 8;
+		src += 24;
+	}
+	for (; count > 0; count--) {
+		uint32 colour = MakeRGBA(ShiftChannel(src[0], shift), ShiftChannel(src[1], shift), ShiftChannel(src[2], shift), OPAQUE);
+		*dest = BlendPixel(colour, *dest, opacity);
+		dest++;
+		src += 3;
+	}
+}
+
+/** AVX2 implementation of #BlitRecolourKernel. */
+TARGET_AVX2 static void BlitRecolourAVX2(uint32 *dest, const uint8 *src, int count, const uint32 *table, uint8 opacity, int shift)
+{
+	const __m256i add = _mm256_set1_epi8(shift > 0 ? shift : 0);
+	const __m256i sub = _mm256_set1_epi8(shift < 0 ? -shift : 0);
+	const __m256i alpha = _mm256_set1_epi32(OPAQUE);
+	const __m256i opac = _mm256_set1_epi16(opacity);
+	const __m256i inverse = _mm256_set1_epi16(256 - opacity);
+	for (; count >= 8; count -= 8) {
+		__m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)src));
+		__m256i pixels = _mm256_i32gather_epi32((const int *)table, indices, 4);
+		pixels = _mm256_subs_epu8(_mm256_adds_epu8(pixels, add), sub);
+		__m256i old = _mm256_loadu_si256((const __m256i *)dest);
+		pixels = BlendAVX2(pixels, old, opac, inverse);
+		_mm256_storeu_si256((__m256i *)dest, _mm256_or_si256(pixels, alpha));
+		dest += 8;
+		src += 8;
+	}
+	for (; count > 0; count--) {
+		uint32 recoloured = table[*src++];
+		uint32 colour = MakeRGBA(ShiftChannel(GetR(recoloured), shift), ShiftChannel(GetG(recoloured), shift), ShiftChannel(GetB(recoloured), shift), OPAQUE);
+		*dest = BlendPixel(colour, *dest, opacity);
+		dest++;
+	}
+}
+
+#endif /* WITH_AVX2 */
+
+/**
+ * Select the fastest kernels supported by the CPU.
+ * @param allow_simd Whether vectorized kernels may be used. If not, the generic blitter code is used.
+ */
+void SelectBlitKernels(bool allow_simd)
+{
+	_blit_kernels = {"generic", nullptr, nullptr, nullptr};
+	if (!allow_simd) return;
+
+#ifdef WITH_SSE2
+	if (SDL_HasSSE2()) _blit_kernels = {"SSE2", BlitOpaqueSSE2, BlitTranslucentSSE2, BlitRecolourSSE2};
+#endif
+#ifdef WITH_AVX2
+	if (SDL_HasAVX2()) _blit_kernels = {"AVX2", BlitOpaqueAVX2, BlitTranslucentAVX2, BlitRecolourAVX2};
+#endif
+}
+
+/**
+ * Pseudo-random number for #CheckBlitKernels. The random generator of the game is not used, to keep the game unaffected.
+ * @param state [inout] State of the generator, must not be \c 0.
+ * @return Next pseudo-random number.
+ */
+static inline uint32 NextCheckNumber(uint32 *state)
+{
+	uint32 x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/**
+ * Check that the selected kernels give bit-exact the same pixels as the generic blitter code, with random runs of pixels.
+ * @param runs Number of random runs to check with each kernel.
+ * @return Number of runs with different pixels, \c 0 if the kernels are correct.
+ */
+uint CheckBlitKernels(uint runs)
+{
+	static const int MAX_RUN = 70; // Longest run to check, more than two AVX2 loops plus a tail.
+
+	uint32 state = 0x12345678;
+	uint8 src[3 * MAX_RUN];
+	uint32 table[256];
+	uint32 expected[MAX_RUN];
+	uint32 actual[MAX_RUN];
+	uint failures = 0;
+	for (uint run = 0; run < runs; run++) {
+		int count = NextCheckNumber(&state) % (MAX_RUN + 1);
+		GradientShift gs = static_cast<GradientShift>(NextCheckNumber(&state) % GS_COUNT);
+		ShiftFunc sf = GetGradientShiftFunc(gs);
+		int shift = (gs - GS_NORMAL) * STEP_SIZE;
+		uint8 opacity = NextCheckNumber(&state);
+		for (uint8 &b : src) b = NextCheckNumber(&state);
+		for (uint32 &p : table) p = NextCheckNumber(&state) | OPAQUE;
+		for (int i = 0; i < count; i++) expected[i] = NextCheckNumber(&state) | OPAQUE;
+
+		if (_blit_kernels.opaque != nullptr) {
+			_blit_kernels.opaque(actual, src, count, shift);
+			for (int i = 0; i < count; i++) {
+				if (actual[i] != MakeRGBA(sf(src[3 * i]), sf(src[3 * i + 1]), sf(src[3 * i + 2]), OPAQUE)) {
+					failures++;
+					break;
+				}
+			}
+		}
+
+		if (_blit_kernels.translucent != nullptr) {
+			std::copy(expected, expected + count, actual);
+			_blit_kernels.translucent(actual, src, count, opacity, shift);
+			for (int i = 0; i < count; i++) {
+				uint32 colour = MakeRGBA(sf(src[3 * i]), sf(src[3 * i + 1]), sf(src[3 * i + 2]), OPAQUE);
+				if (actual[i] != BlendPixel(colour, expected[i], opacity)) {
+					failures++;
+					break;
+				}
+			}
+		}
+
+		if (_blit_kernels.recolour != nullptr) {
+			std::copy(expected, expected + count, actual);
+			_blit_kernels.recolour(actual, src, count, table, opacity, shift);
+			for (int i = 0; i < count; i++) {
+				uint32 recoloured = table[src[i]];
+				uint32 colour = MakeRGBA(sf(GetR(recoloured)), sf(GetG(recoloured)), sf(GetB(recoloured)), OPAQUE);
+				if (actual[i] != BlendPixel(colour, expected[i], opacity)) {
+					failures++;
+					break;
+				}
+			}
+		}
+	}
+	return failures;
+}
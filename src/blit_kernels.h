@@ -0,0 +1,61 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file blit_kernels.h Vectorized blitting of runs of 32bpp sprite pixels. */
+
+#ifndef BLIT_KERNELS_H
+#define BLIT_KERNELS_H
+
+/**
+ * Blit a run of fully opaque pixels.
+ * @param dest First pixel to write.
+ * @param src Red, green, and blue bytes of the pixels.
+ * @param count Number of pixels in the run.
+ * @param shift Gradient shift amount added to every colour channel (with saturation).
+ */
+typedef void (*BlitOpaqueKernel)(uint32 *dest, const uint8 *src, int count, int shift);
+
+/**
+ * Blit a run of pixels with the same opacity onto the existing pixels.
+ * @param dest First pixel to write.
+ * @param src Red, green, and blue bytes of the pixels.
+ * @param count Number of pixels in the run.
+ * @param opacity Opacity of the pixels.
+ * @param shift Gradient shift amount added to every colour channel (with saturation).
+ */
+typedef void (*BlitTranslucentKernel)(uint32 *dest, const uint8 *src, int count, uint8 opacity, int shift);
+
+/**
+ * Blit a run of recoloured pixels with the same opacity onto the existing pixels.
+ * @param dest First pixel to write.
+ * @param src Recolour table indices of the pixels.
+ * @param count Number of pixels in the run.
+ * @param table Recolour table.
+ * @param opacity Opacity of the pixels.
+ * @param shift Gradient shift amount added to every colour channel (with saturation).
+ */
+typedef void (*BlitRecolourKernel)(uint32 *dest, const uint8 *src, int count, const uint32 *table, uint8 opacity, int shift);
+
+/**
+ * Vectorized kernels for blitting runs of a 32bpp sprite that are completely inside the clipped area.
+ * The results are bit-exact with the generic blitter code. Kernels are \c nullptr if the CPU has no support for them.
+ */
+struct BlitKernels {
+	const char *name;                  ///< Name of the instruction set used by the kernels.
+	BlitOpaqueKernel opaque;           ///< Kernel for fully opaque pixels.
+	BlitTranslucentKernel translucent; ///< Kernel for partially opaque pixels.
+	BlitRecolourKernel recolour;       ///< Kernel for recoloured pixels.
+};
+
+extern BlitKernels _blit_kernels;
+
+void SelectBlitKernels(bool allow_simd = true);
+uint CheckBlitKernels(uint runs);
+
+#endif
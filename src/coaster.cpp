@@ -221,7 +221,7 @@ DisplayCoasterCar::DisplayCoasterCar() : VoxelObject(), yaw(0xff) // Mark everyt
 const ImageData *DisplayCoasterCar::GetSprite(const SpriteStorage *sprites, ViewOrientation orient, const Recolouring **recolour) const
 {
 	*recolour = nullptr;
-	return this->car_type->GetCar(this->pitch, this->roll, (this->yaw + orient * 4) & 0xF);
+	return sprites->ScaleSprite(this->car_type->GetCar(this->pitch, this->roll, (this->yaw + orient * 4) & 0xF));
 }
 
 /**
@@ -11,6 +11,7 @@
 
 #include "stdafx.h"
 #include "window.h"
+#include "viewport.h"
 #include "palette.h"
 #include "bitmath.h"
 
@@ -250,6 +251,7 @@ void RecolourDropdownWindow::OnClick(WidgetNumber widget, const Point16 &pos)
 
 		if (this->entry->dest != widget - RD_BUTTON_00) {
 			this->entry->dest = static_cast<ColourRange>(widget - RD_BUTTON_00);
+			MarkWorldDirty(); // The recoloured ride may be anywhere in the world.
 			_video.MarkDisplayDirty();
 		}
 
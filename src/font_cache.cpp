@@ -0,0 +1,167 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file font_cache.cpp Cache of rendered glyphs and laid out text. */
+
+#include "stdafx.h"
+#include "font_cache.h"
+#include "string_func.h"
+
+static const uint MAX_CACHED_LAYOUTS = 512; ///< Maximal number of laid out texts in the cache.
+
+FontCache::FontCache()
+{
+	this->font = nullptr;
+	this->layout_hits = 0;
+	this->layout_misses = 0;
+}
+
+/**
+ * Set the font of the glyphs, dropping all cached data of the previous font.
+ * @param font New font, may be \c nullptr.
+ */
+void FontCache::SetFont(TTF_Font *font)
+{
+	this->font = font;
+	this->glyphs.clear();
+	this->glyph_index.clear();
+	this->atlas.clear();
+	this->layouts.clear();
+	this->layout_index.clear();
+}
+
+/**
+ * Get the glyph of a code point, rendering it if it is not in the atlas yet.
+ * @param codepoint Code point of the character.
+ * @param text UTF-8 encoding of the character.
+ * @param length Length of the UTF-8 encoding in bytes.
+ * @return Index of the glyph.
+ */
+uint16 FontCache::GetGlyphIndex(uint32 codepoint, const uint8 *text, int length)
+{
+	auto iter = this->glyph_index.find(codepoint);
+	if (iter != this->glyph_index.end()) return iter->second;
+
+	CachedGlyph glyph = {0, 0, 0, 0, static_cast<uint32>(this->atlas.size())};
+	int minx, maxx, miny, maxy, advance;
+	if (codepoint <= 0xFFFF && TTF_GlyphMetrics(this->font, codepoint, &minx, &maxx, &miny, &maxy, &advance) == 0) {
+		glyph.xoffset = std::min(minx, 0); // Glyphs extending to the left are moved to the right by SDL_ttf.
+		glyph.advance = advance;
+	}
+
+	/* Render the character as a string, so the mask is positioned the same way as in rendered text. */
+	std::string str(reinterpret_cast<const char *>(text), length);
+	SDL_Color col = {0, 0, 0}; // Font colour does not matter as only the bitmap is used.
+	SDL_Surface *surf = TTF_RenderUTF8_Solid(this->font, str.c_str(), col);
+	if (surf != nullptr) {
+		if (surf->format->BitsPerPixel == 8 && surf->format->BytesPerPixel == 1) {
+			glyph.width = surf->w;
+			glyph.height = surf->h;
+			for (int y = 0; y < surf->h; y++) {
+				const uint8 *row = static_cast<const uint8 *>(surf->pixels) + y * surf->pitch;
+				this->atlas.insert(this->atlas.end(), row, row + surf->w);
+			}
+		}
+		SDL_FreeSurface(surf);
+	}
+
+	assert(this->glyphs.size() < UINT16_MAX);
+	uint16 index = this->glyphs.size();
+	this->glyphs.push_back(glyph);
+	this->glyph_index[codepoint] = index;
+	return index;
+}
+
+/**
+ * Get the kerning between two characters, if the SDL_ttf version supports it.
+ * @param font Font of the characters.
+ * @param previous Code point of the first character.
+ * @param codepoint Code point of the second character.
+ * @return Horizontal adjustment of the second character.
+ */
+static int GetKerning(TTF_Font *font, uint32 previous, uint32 codepoint)
+{
+#ifdef SDL_TTF_VERSION_ATLEAST
+#if SDL_TTF_VERSION_ATLEAST(2, 0, 14)
+	if (TTF_GetFontKerning(font) != 0 && previous <= 0xFFFF && codepoint <= 0xFFFF) return TTF_GetFontKerningSizeGlyphs(font, previous, codepoint);
+#endif
+#endif
+	return 0;
+}
+
+/**
+ * Lay out text with the glyphs of the atlas, like SDL_ttf positions the glyphs of rendered text.
+ * @param text Text to lay out.
+ * @param layout [out] Layout of the text.
+ */
+void FontCache::LayoutText(const uint8 *text, TextLayout *layout)
+{
+	if (TTF_SizeUTF8(this->font, reinterpret_cast<const char *>(text), &layout->width, &layout->height) != 0) {
+		layout->width = 0;
+		layout->height = 0;
+		return;
+	}
+
+	int pen = 0;
+	size_t length = StrBytesLength(text);
+	uint32 previous = 0;
+	while (length > 0) {
+		uint32 codepoint;
+		int size = DecodeUtf8Char(text, length, &codepoint);
+		if (size == 0) { // Skip bad bytes.
+			text++;
+			length--;
+			continue;
+		}
+
+		uint16 index = this->GetGlyphIndex(codepoint, text, size);
+		const CachedGlyph &glyph = this->glyphs[index];
+		if (layout->glyphs.empty()) {
+			pen -= glyph.xoffset;
+		} else {
+			pen += GetKerning(this->font, previous, codepoint);
+		}
+		layout->glyphs.push_back({static_cast<int16>(pen + glyph.xoffset), index});
+		pen += glyph.advance;
+
+		previous = codepoint;
+		text += size;
+		length -= size;
+	}
+}
+
+/**
+ * Get the layout of a text.
+ * @param text Text to lay out.
+ * @return Layout of the text, valid until the next call.
+ */
+const TextLayout &FontCache::GetLayout(const uint8 *text)
+{
+	std::string key(reinterpret_cast<const char *>(text));
+	auto iter = this->layout_index.find(key);
+	if (iter != this->layout_index.end()) {
+		this->layout_hits++;
+		this->layouts.splice(this->layouts.begin(), this->layouts, iter->second);
+		return iter->second->second;
+	}
+
+	this->layout_misses++;
+	if (this->layouts.size() >= MAX_CACHED_LAYOUTS) {
+		this->layout_index.erase(this->layouts.back().first);
+		this->layouts.pop_back();
+	}
+	this->layouts.emplace_front(key, TextLayout());
+	this->layout_index.emplace(key, this->layouts.begin());
+
+	TextLayout &layout = this->layouts.front().second;
+	layout.width = 0;
+	layout.height = 0;
+	if (this->font != nullptr) this->LayoutText(text, &layout);
+	return layout;
+}
@@ -0,0 +1,93 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file font_cache.h Cache of rendered glyphs and laid out text. */
+
+#ifndef FONT_CACHE_H
+#define FONT_CACHE_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <SDL_ttf.h>
+
+/** Rendered glyph of the font in the atlas of the #FontCache. */
+struct CachedGlyph {
+	int16 xoffset; ///< Horizontal offset of the mask relative to the pen position.
+	int16 advance; ///< Horizontal movement of the pen after drawing the glyph.
+	uint16 width;  ///< Width of the mask.
+	uint16 height; ///< Height of the mask.
+	uint32 mask;   ///< Offset of the mask in the atlas, one byte for each pixel (non-zero means the pixel is set).
+};
+
+/** Glyph at its position in a #TextLayout. */
+struct PlacedGlyph {
+	int16 xpos;   ///< Horizontal position of the mask relative to the start of the text.
+	uint16 index; ///< Index of the glyph in the #FontCache.
+};
+
+/** Text laid out with glyphs of the #FontCache. */
+struct TextLayout {
+	int width;  ///< Width of the text in pixels.
+	int height; ///< Height of the text in pixels.
+	std::vector<PlacedGlyph> glyphs; ///< Glyphs of the text.
+};
+
+/**
+ * Cache of the glyphs of a font and of recently used text layouts, to avoid rendering text with SDL_ttf at every repaint.
+ * Glyphs are rendered once and stored in an atlas, strings are laid out from the glyphs, and the least recently
+ * used layouts are dropped when there are too many.
+ */
+class FontCache {
+public:
+	FontCache();
+
+	void SetFont(TTF_Font *font);
+	const TextLayout &GetLayout(const uint8 *text);
+
+	/**
+	 * Get a glyph of the atlas.
+	 * @param index Index of the glyph.
+	 * @return The glyph.
+	 */
+	inline const CachedGlyph &GetGlyph(uint16 index) const
+	{
+		return this->glyphs[index];
+	}
+
+	/**
+	 * Get the mask of a glyph.
+	 * @param glyph Glyph of the atlas.
+	 * @return Rows of the mask, each \c glyph.width bytes long.
+	 */
+	inline const uint8 *GetMask(const CachedGlyph &glyph) const
+	{
+		return this->atlas.data() + glyph.mask;
+	}
+
+	uint64 layout_hits;   ///< Number of times a layout was found in the cache.
+	uint64 layout_misses; ///< Number of times text had to be laid out.
+
+private:
+	/** Laid out text with its UTF-8 bytes, in order of use. */
+	typedef std::list<std::pair<std::string, TextLayout>> LayoutList;
+
+	uint16 GetGlyphIndex(uint32 codepoint, const uint8 *text, int length);
+	void LayoutText(const uint8 *text, TextLayout *layout);
+
+	TTF_Font *font;                        ///< Font of the glyphs, \c nullptr if not set.
+	std::vector<CachedGlyph> glyphs;       ///< Rendered glyphs.
+	std::map<uint32, uint16> glyph_index;  ///< Index of the rendered glyph of a code point.
+	std::vector<uint8> atlas;              ///< Masks of all glyphs.
+	LayoutList layouts;                    ///< Laid out text, most recently used first.
+	std::map<std::string, LayoutList::iterator> layout_index; ///< Laid out text by its UTF-8 bytes.
+};
+
+#endif
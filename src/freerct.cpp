@@ -15,6 +15,7 @@
 #include "viewport.h"
 #include "rcdfile.h"
 #include "sprite_data.h"
+#include "sprite_cache.h"
 #include "sprite_store.h"
 #include "window.h"
 #include "config_reader.h"
@@ -22,6 +23,8 @@
 #include "getoptdata.h"
 #include "fileio.h"
 #include "gamecontrol.h"
+#include "worker_pool.h"
+#include "render_stats.h"
 
 void InitMouseModes();
 
@@ -44,6 +47,7 @@ void error(const char *str, ...)
 /** Command-line options of the program. */
 static const OptionData _options[] = {
 	GETOPT_NOVAL('h', "--help"),
+	GETOPT_VALUE('p', "--perf-log"),
 	GETOPT_END()
 };
 
@@ -52,7 +56,8 @@ static void PrintUsage()
 {
 	printf("Usage: freerct [options]\n");
 	printf("Options:\n");
-	printf("  -h, --help     Display this help text and exit\n");
+	printf("  -h, --help             Display this help text and exit\n");
+	printf("  -p, --perf-log <file>  Write the measurements of every rendered frame to a CSV file\n");
 }
 
 /** Show that there are missing sprites. */
@@ -72,6 +77,7 @@ void ShowGraphicsErrorMessage()
 int freerct_main(int argc, char **argv)
 {
 	GetOptData opt_data(argc - 1, argv + 1, _options);
+	const char *perf_log = nullptr;
 
 	int opt_id;
 	do {
@@ -81,6 +87,10 @@ int freerct_main(int argc, char **argv)
 				PrintUsage();
 				return 0;
 
+			case 'p':
+				perf_log = opt_data.opt;
+				break;
+
 			case -1:
 				break;
 
@@ -96,7 +106,6 @@ int freerct_main(int argc, char **argv)
 	ChangeWorkingDirectoryToExecutable(argv[0]);
 
 	/* Load RCD files. */
-	InitImageStorage();
 	_rcd_collection.ScanDirectories();
 	_sprite_manager.LoadRcdFiles();
 
@@ -119,6 +128,13 @@ int freerct_main(int argc, char **argv)
 		return 1;
 	}
 
+	int sprite_cache_size = cfg_file.GetNum("video", "sprite-cache-size");
+	if (sprite_cache_size >= 0) _sprite_cache.SetMemoryLimit(static_cast<size_t>(sprite_cache_size) * 1024 * 1024);
+
+	int frame_rate = cfg_file.GetNum("video", "frame-rate");
+	_video.SetFramePacing((frame_rate >= 0) ? frame_rate : DEFAULT_FRAME_RATE, cfg_file.GetNum("video", "vsync") == 1);
+	_video.SetStreaming(cfg_file.GetNum("video", "streaming") > 0);
+
 	/* Initialize video. */
 	std::string err = _video.Initialize(font_path, font_size);
 	if (!err.empty()) {
@@ -126,17 +142,22 @@ int freerct_main(int argc, char **argv)
 		return 1;
 	}
 
+	_worker_pool.Initialize(0);
 	InitMouseModes();
 
 	StartNewGame();
 
+	if (perf_log != nullptr && !_performance.OpenLog(perf_log)) fprintf(stderr, "Failed to open \"%s\", frames are not logged\n", perf_log);
+
 	/* Loops until told not to. */
 	_video.MainLoop();
+	_performance.CloseLog();
 
 	/* Closing down. */
 	ShutdownGame();
 	UninitLanguage();
 	DestroyImageStorage();
+	_worker_pool.Shutdown();
 	_video.Shutdown();
 	return 0;
 }
@@ -22,6 +22,7 @@
 #include "viewport.h"
 #include "weather.h"
 #include "freerct.h"
+#include "render_stats.h"
 
 /** Initialize all game data structures for playing a new game. */
 void StartNewGame()
@@ -76,17 +77,28 @@ void OnNewDay()
 	_guests.OnNewDay();
 	_weather.OnNewDay();
 	NotifyChange(WC_BOTTOM_TOOLBAR, ALL_WINDOWS_OF_TYPE, CHG_DISPLAY_OLD, 0);
+	NotifyChange(WC_MAINDISPLAY, ALL_WINDOWS_OF_TYPE, CHG_DISPLAY_OLD, 0);
 }
 
 /**
- * For every frame do...
- * @param frame_delay Number of milliseconds between two frames.
+ * For every simulation step do...
+ * @param frame_delay Number of milliseconds of game time in a step.
 */
 void OnNewFrame(uint32 frame_delay)
 {
+	_render_times.sim_steps++;
 	_window_manager.Tick();
-	_guests.DoTick();
+	{
+		StepTimer timer(SS_GUESTS_DAILY);
+		_guests.DoTick();
+	}
 	DateOnTick();
-	_guests.OnAnimate(frame_delay);
-	_rides_manager.OnAnimate(frame_delay);
+	{
+		StepTimer timer(SS_GUESTS_ANIMATE);
+		_guests.OnAnimate(frame_delay);
+	}
+	{
+		StepTimer timer(SS_RIDES_ANIMATE);
+		_rides_manager.OnAnimate(frame_delay);
+	}
 }
@@ -241,6 +241,19 @@ struct Rectangle {
 		return true;
 	}
 
+	/**
+	 * Is the given rectangle completely inside this rectangle?
+	 * @param rect Other rectangle.
+	 * @return All of the area of \a rect is also covered by this rectangle.
+	 */
+	bool Contains(const Rectangle<PT, SZ> &rect) const
+	{
+		if (rect.base.x < this->base.x || rect.base.y < this->base.y) return false;
+		if (rect.base.x + (typename PT::CoordType)rect.width > this->base.x + (typename PT::CoordType)this->width) return false;
+		if (rect.base.y + (typename PT::CoordType)rect.height > this->base.y + (typename PT::CoordType)this->height) return false;
+		return true;
+	}
+
 	/**
 	 * Is a given coordinate inside the rectangle?
 	 * @param pt %Point to test.
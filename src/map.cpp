@@ -142,7 +142,7 @@ VoxelObject::~VoxelObject()
 /** Mark the voxel containing the voxel object as dirty, so it is repainted. */
 void VoxelObject::MarkDirty()
 {
-	MarkVoxelDirty(this->vox_pos);
+	MarkVoxelDisplayDirty(this->vox_pos);
 }
 
 /** Default constructor. */
@@ -644,11 +644,11 @@ WorldAdditions::WorldAdditions()
 
 WorldAdditions::~WorldAdditions()
 {
-	this->Clear();
+	this->DeleteStacks();
 }
 
-/** Remove all modifications. */
-void WorldAdditions::Clear()
+/** Delete the modified stacks, without updating the display. */
+void WorldAdditions::DeleteStacks()
 {
 	for (auto &iter : this->modified_stacks) {
 		delete iter.second;
@@ -656,14 +656,37 @@ void WorldAdditions::Clear()
 	this->modified_stacks.clear();
 }
 
+/**
+ * Mark the voxels of the modified stacks, and of the stacks in the #_world at the same positions, as dirty.
+ * The world at these stacks is about to change for the user, since the modifications disappear or become part of the #_world.
+ */
+void WorldAdditions::MarkStacksDirty() const
+{
+	for (const auto &iter : this->modified_stacks) {
+		const Point32 pt = iter.first;
+		const VoxelStack *vstack = iter.second;
+		if (vstack != nullptr) MarkVoxelDirty(XYZPoint16(pt.x, pt.y, vstack->base), vstack->height);
+		vstack = _world.GetStack(pt.x, pt.y);
+		MarkVoxelDirty(XYZPoint16(pt.x, pt.y, vstack->base), vstack->height);
+	}
+}
+
+/** Remove all modifications. */
+void WorldAdditions::Clear()
+{
+	this->MarkStacksDirty();
+	this->DeleteStacks();
+}
+
 /** Move modifications to the 'real' #_world. */
 void WorldAdditions::Commit()
 {
+	this->MarkStacksDirty();
 	for (auto &iter : this->modified_stacks) {
 		Point32 pt = iter.first;
 		_world.MoveStack(pt.x, pt.y, iter.second);
 	}
-	this->Clear();
+	this->DeleteStacks();
 }
 
 /**
@@ -622,6 +622,9 @@ public:
 
 protected:
 	VoxelStackMap modified_stacks; ///< Modified voxel stacks.
+
+	void MarkStacksDirty() const;
+	void DeleteStacks();
 };
 
 extern VoxelWorld _world;
@@ -50,6 +50,19 @@ static inline int sign(int val)
 	return 0;
 }
 
+/**
+ * Divide \a num by \a den, rounding towards negative infinity (unlike the '/' operator which rounds towards zero).
+ * @param num Numerator.
+ * @param den Denominator, must be positive.
+ * @return Largest integer not bigger than \a num / \a den.
+ */
+static inline int FloorDiv(int num, int den)
+{
+	assert(den > 0);
+	if (num >= 0) return num / den;
+	return -((-num + den - 1) / den);
+}
+
 int GreatestCommonDivisor(int a, int b);
 int LeastCommonMultiple(int a, int b);
 int CountBits(uint num);
@@ -15,6 +15,8 @@
 #include "palette.h"
 #include "random.h"
 
+#include <map>
+
 /** Default constructor. */
 RecolourEntry::RecolourEntry() : source(COL_RANGE_INVALID), dest(COL_RANGE_INVALID), dest_set(0)
 {
@@ -94,11 +96,98 @@ void RecolourEntry::AssignDest(ColourRange dest)
 	}
 }
 
+/** Palettes of all recolourings with the same recolour entries. */
+struct SharedRecolouring {
+	uint64 key;                   ///< Key of the recolour entries. @see Recolouring::GetKey
+	uint32 refs;                  ///< Number of recolourings using the palettes.
+	uint8 *colour_maps[GS_COUNT]; ///< Palette for each gradient shift, \c nullptr if not computed yet.
+};
+
+/** Shared palettes of the recolourings, by key of their recolour entries. */
+typedef std::map<uint64, SharedRecolouring *> SharedRecolouringMap;
+
+/**
+ * Get the table of shared palettes.
+ * The table is never deleted, as recolourings in other global objects may be destructed after it.
+ * @return The table of shared palettes.
+ */
+static SharedRecolouringMap &GetSharedRecolourings()
+{
+	static SharedRecolouringMap *table = new SharedRecolouringMap;
+	return *table;
+}
+
+/**
+ * Get the shared palettes of recolour entries, and start using them.
+ * @param key Key of the recolour entries.
+ * @return The shared palettes.
+ */
+static SharedRecolouring *AcquireSharedRecolouring(uint64 key)
+{
+	SharedRecolouringMap &table = GetSharedRecolourings();
+	auto iter = table.find(key);
+	if (iter != table.end()) {
+		iter->second->refs++;
+		return iter->second;
+	}
+
+	SharedRecolouring *shared = new SharedRecolouring;
+	shared->key = key;
+	shared->refs = 1;
+	for (int i = 0; i < GS_COUNT; i++) shared->colour_maps[i] = nullptr;
+	table[key] = shared;
+	return shared;
+}
+
+/**
+ * Stop using shared palettes. Palettes that are not used any more are deleted.
+ * @param shared Shared palettes to stop using, may be \c nullptr.
+ */
+static void ReleaseSharedRecolouring(SharedRecolouring *shared)
+{
+	if (shared == nullptr) return;
+	assert(shared->refs > 0);
+	shared->refs--;
+	if (shared->refs > 0) return;
+
+	GetSharedRecolourings().erase(shared->key);
+	for (int i = 0; i < GS_COUNT; i++) delete[] shared->colour_maps[i];
+	delete shared;
+}
+
+/**
+ * Compute the palette of recolour entries and a gradient shift.
+ * @param key Key of the recolour entries.
+ * @param shift Applied gradient shift.
+ * @param colour_map [out] 8bpp palette, including recolouring.
+ */
+static void ComputeColourMap(uint64 key, GradientShift shift, uint8 *colour_map)
+{
+	/* Find the colour range to use as replacement for each colour range. */
+	int replacement[COL_RANGE_COUNT];
+	for (int rng = 0; rng < COL_RANGE_COUNT; rng++) replacement[rng] = rng;
+	for (int i = 0; i < MAX_RECOLOUR; i++) {
+		uint8 src = key >> (16 * i);
+		uint8 dest = key >> (16 * i + 8);
+		if (src < COL_RANGE_COUNT && dest < COL_RANGE_COUNT) replacement[src] = dest;
+	}
+
+	for (int i = 0; i < COL_SERIES_START; i++) colour_map[i] = i;
+	for (int i = COL_SERIES_END; i < 256; i++) colour_map[i] = i;
+	for (int rng = 0; rng < COL_RANGE_COUNT; rng++) {
+		int base = GetColourRangeBase((ColourRange)rng);
+		int baseval = GetColourRangeBase((ColourRange)replacement[rng]);
+		for (int col = 0; col < COL_SERIES_LENGTH; col++) {
+			colour_map[base + col] = baseval + Clamp(col + shift - GS_NORMAL, 0, COL_SERIES_LENGTH - 1);
+		}
+	}
+}
+
 /** Default constructor. */
 Recolouring::Recolouring()
 {
 	this->Reset();
-	this->InvalidateColourMap();
+	this->shared = nullptr;
 }
 
 /**
@@ -108,6 +197,12 @@ Recolouring::Recolouring()
 Recolouring::Recolouring(const Recolouring &rc)
 {
 	std::copy(&rc.entries[0], endof(rc.entries), this->entries);
+	this->shared = nullptr;
+}
+
+Recolouring::~Recolouring()
+{
+	ReleaseSharedRecolouring(this->shared);
 }
 
 /**
@@ -138,7 +233,6 @@ void Recolouring::Set(int index, const RecolourEntry &entry)
 {
 	if (index >= MAX_RECOLOUR) return;
 	this->entries[index] = entry;
-	this->InvalidateColourMap();
 }
 
 /** Select random destination colour ranges for the recolour entries. */
@@ -169,39 +263,43 @@ void Recolouring::AssignRandomColours()
 }
 
 /**
- * Compute the palette of the #Recolouring object from the #entries and the gradient shift.
- * @param shift Applied gradient shift.
- * @return 8bpp palette, including recolouring.
+ * Get the key of the recolour entries, the source and destination colour range of every entry.
+ * Recolourings with the same key look the same.
+ * @return Key of the recolour entries.
  */
-const uint8 *Recolouring::GetPalette(GradientShift shift) const
+uint64 Recolouring::GetKey() const
 {
-	if (this->shift == shift) return this->colour_map;
-
-	for (int i = 0; i < COL_SERIES_START; i++) this->colour_map[i] = i;
-	for (int i = COL_SERIES_END; i < 256; i++) this->colour_map[i] = i;
-	for (int rng = 0; rng < COL_RANGE_COUNT; rng++) {
-		int base = GetColourRangeBase((ColourRange)rng);
-		int baseval = GetColourRangeBase(this->GetReplacementRange((ColourRange)rng));
-		for (int col = 0; col < COL_SERIES_LENGTH; col++) {
-			this->colour_map[base + col] = baseval + Clamp(col + shift - GS_NORMAL, 0, COL_SERIES_LENGTH - 1);
-		}
+	uint64 key = 0;
+	for (int i = 0; i < MAX_RECOLOUR; i++) {
+		const RecolourEntry &re = this->entries[i];
+		key |= static_cast<uint64>((re.source & 0xFF) | ((re.dest & 0xFF) << 8)) << (16 * i);
 	}
-	this->shift = shift;
-	return this->colour_map;
+	return key;
 }
 
 /**
- * Find the coloure range to use as replacement for the \a src colour range.
- * @param src Colour range to replace.
- * @return Colour range to use instead of \a src (may be \a src again).
+ * Get the palette of the #Recolouring object from the #entries and the gradient shift.
+ * The palette is shared with all recolourings with the same entries, and computed only once for each gradient shift.
+ * @param shift Applied gradient shift.
+ * @return 8bpp palette, including recolouring.
+ * @note Only the main thread may retrieve a palette that was not retrieved before.
  */
-ColourRange Recolouring::GetReplacementRange(ColourRange src) const
+const uint8 *Recolouring::GetPalette(GradientShift shift) const
 {
-	ColourRange dest = src;
-	for (int i = 0; i < MAX_RECOLOUR; i++) {
-		if (this->entries[i].source == src && this->entries[i].dest != COL_RANGE_INVALID) dest = this->entries[i].dest;
+	uint64 key = this->GetKey();
+	if (this->shared == nullptr || this->shared->key != key) {
+		SharedRecolouring *shared = AcquireSharedRecolouring(key);
+		ReleaseSharedRecolouring(this->shared);
+		this->shared = shared;
+	}
+
+	assert(shift < GS_COUNT);
+	uint8 *&colour_map = this->shared->colour_maps[shift];
+	if (colour_map == nullptr) {
+		colour_map = new uint8[256];
+		ComputeColourMap(key, shift, colour_map);
 	}
-	return dest;
+	return colour_map;
 }
 
 const uint32 _palette[256] = {
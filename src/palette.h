@@ -292,20 +292,25 @@ struct RecolourEntry {
 	uint32 dest_set;    ///< Bit set of destination colour ranges to chose from.
 };
 
+struct SharedRecolouring;
+
 /**
  * Sprite recolouring information.
  * All information of a sprite recolouring. The gradient colour shift is handled separately, as it changes often.
+ * The 8bpp palettes are shared by all recolourings with the same recolour entries.
  */
 class Recolouring {
 public:
 	Recolouring();
 	Recolouring(const Recolouring &sr);
+	~Recolouring();
 	Recolouring &operator=(const Recolouring &sr);
 
 	void Reset();
 	void Set(int index, const RecolourEntry &entry);
 	void AssignRandomColours();
 
+	uint64 GetKey() const;
 	const uint8 *GetPalette(GradientShift shift) const;
 
 	/**
@@ -329,16 +334,7 @@ public:
 	RecolourEntry entries[MAX_RECOLOUR];
 
 private:
-	/** Invalidate the colour map used last time. */
-	void InvalidateColourMap()
-	{
-		this->shift = GS_INVALID;
-	}
-
-	ColourRange GetReplacementRange(ColourRange src) const;
-
-	mutable uint8 colour_map[256]; ///< Colour map used last time.
-	mutable GradientShift shift;   ///< Gradient shift used last time, #GS_INVALID if the #colour_map is not valid.
+	mutable SharedRecolouring *shared; ///< Palettes of the recolouring, \c nullptr if not used yet. Outdated if its key differs from #GetKey.
 };
 
 #endif
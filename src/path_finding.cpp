@@ -12,6 +12,7 @@
 #include "stdafx.h"
 #include "path_finding.h"
 #include "map.h"
+#include "render_stats.h"
 
 /**
  * Constructor of a walked position.
@@ -126,6 +127,7 @@ void PathSearcher::AddOpen(const XYZPoint16 &vox, uint32 traveled, const WalkedP
  */
 bool PathSearcher::Search()
 {
+	_render_times.path_searches++;
 	this->dest_pos = nullptr;
 	while (!open_points.empty()) {
 		WalkedDistance wd = *open_points.begin();
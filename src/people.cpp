@@ -19,6 +19,10 @@
 #include "person.h"
 #include "people.h"
 #include "gamelevel.h"
+#include "window.h"
+#include "worker_pool.h"
+#include "viewport.h"
+#include <algorithm>
 
 Guests _guests; ///< %Guests in the world/park.
 
@@ -68,70 +72,158 @@ static Point16 FindEdgeRoad()
 	return {-1, -1};
 }
 
-Guests::Guests() : block(0), rnd()
+AnimationWheel::AnimationWheel()
 {
-	this->free_idx = 0;
-	this->start_voxel.x = -1;
-	this->start_voxel.y = -1;
-	this->daily_frac = 0;
-	this->next_daily_index = 0;
+	this->now = 0;
+	for (uint i = 0; i < lengthof(this->slots); i++) this->slots[i] = -1;
 }
 
-Guests::~Guests()
+/**
+ * Set the number of guests that can be scheduled.
+ * @param capacity Number of guests, guest ids are less than this number. Must not decrease.
+ */
+void AnimationWheel::SetCapacity(uint capacity)
 {
+	assert(capacity >= this->prev.size());
+	this->wake_time.resize(capacity, 0);
+	this->next.resize(capacity, -1);
+	this->prev.resize(capacity, WHEEL_UNSCHEDULED);
+}
+
+/**
+ * Schedule a guest to be woken up after some time. A scheduled guest is rescheduled.
+ * @param id Id of the guest to schedule.
+ * @param delay Number of milliseconds until the guest is due, between \c 1 and #MAX_ANIMATION_DELAY.
+ */
+void AnimationWheel::Schedule(uint id, uint32 delay)
+{
+	assert(delay > 0 && delay <= MAX_ANIMATION_DELAY);
+
+	this->Remove(id);
+	this->wake_time[id] = this->now + delay;
+	this->Insert(id);
 }
 
 /**
- * Update #free_idx to the next free guest (if available).
- * @return Whether a free guest was found.
+ * Add a guest to the slot of its wake up time.
+ * @param id Id of the guest to add, must not be scheduled.
  */
-bool Guests::FindNextFreeGuest()
+void AnimationWheel::Insert(uint id)
 {
-	while (this->free_idx < GUEST_BLOCK_SIZE) {
-		Guest *g = this->block.Get(this->free_idx);
-		if (!g->IsActive()) return true;
-		this->free_idx++;
+	uint32 wake_time = this->wake_time[id];
+	int32 slot;
+	if (wake_time - this->now < ANIMATION_WHEEL_SIZE) {
+		slot = wake_time % ANIMATION_WHEEL_SIZE;
+	} else {
+		slot = ANIMATION_WHEEL_SIZE + (wake_time >> ANIMATION_WHEEL_BITS) % ANIMATION_WHEEL_SIZE;
 	}
-	return false;
+
+	int32 first = this->slots[slot];
+	this->next[id] = first;
+	if (first >= 0) this->prev[first] = id;
+	this->prev[id] = -1 - slot;
+	this->slots[slot] = id;
 }
 
 /**
- * Update #free_idx to the next free guest (if available).
- * @return Whether a free guest was found.
+ * Remove a guest from the wheel, if it is scheduled.
+ * @param id Id of the guest to remove.
  */
-bool Guests::FindNextFreeGuest() const
+void AnimationWheel::Remove(uint id)
 {
-	uint idx = this->free_idx;
-	while (idx < GUEST_BLOCK_SIZE) {
-		const Guest *g = this->block.Get(idx);
-		if (!g->IsActive()) return true;
-		idx++;
+	int32 prev = this->prev[id];
+	if (prev == WHEEL_UNSCHEDULED) return;
+
+	int32 next = this->next[id];
+	if (prev >= 0) {
+		this->next[prev] = next;
+	} else {
+		this->slots[-1 - prev] = next;
 	}
-	return false;
+	if (next >= 0) this->prev[next] = prev;
+	this->next[id] = -1;
+	this->prev[id] = WHEEL_UNSCHEDULED;
 }
 
 /**
- * Count the number of active guests.
- * @return The number of active guests.
+ * Advance the time of the wheel, and take out the guests that become due.
+ * @param delay Number of milliseconds to advance.
+ * @param due [out] Ids of the guests that became due are added to it.
  */
-uint Guests::CountActiveGuests()
+void AnimationWheel::Advance(uint32 delay, std::vector<uint16> *due)
 {
-	uint count = this->free_idx > 0;
-	for (uint i = this->free_idx; i < GUEST_BLOCK_SIZE; i++) {
-		Guest *g = this->block.Get(i);
-		if (g->IsActive()) count++;
+	for (; delay > 0; delay--) {
+		this->now++;
+		uint index = this->now % ANIMATION_WHEEL_SIZE;
+		if (index == 0) {
+			/* Start of the range of the next slot of the second level, move its guests to the first level. */
+			int32 *slot = &this->slots[ANIMATION_WHEEL_SIZE + (this->now >> ANIMATION_WHEEL_BITS) % ANIMATION_WHEEL_SIZE];
+			while (*slot >= 0) {
+				uint id = *slot;
+				this->Remove(id);
+				this->Insert(id);
+			}
+		}
+
+		int32 *slot = &this->slots[index];
+		while (*slot >= 0) {
+			uint id = *slot;
+			this->Remove(id);
+			due->push_back(id);
+		}
 	}
-	return count;
+}
+
+Guests::Guests() : rnd()
+{
+	this->free_list = nullptr;
+	this->active_count = 0;
+	this->animation_step = 1;
+	this->start_voxel.x = -1;
+	this->start_voxel.y = -1;
+	this->daily_frac = 0;
+	this->next_daily_index = 0;
+}
+
+Guests::~Guests()
+{
+	for (GuestBlock *block : this->blocks) delete block;
 }
 
 /**
- * Some time has passed, update the animation.
+ * Add a block of non-active guests.
+ * @return Whether a block could be added.
+ */
+bool Guests::AddBlock()
+{
+	if (this->blocks.size() >= MAX_GUEST_BLOCKS) return false;
+
+	GuestBlock *block = new GuestBlock(this->GetCapacity());
+	this->blocks.push_back(block);
+	this->wheel.SetCapacity(this->GetCapacity());
+	/* Link the guests in reverse, so the guests with the lowest index get used first. */
+	for (int i = GUEST_BLOCK_SIZE - 1; i >= 0; i--) {
+		Guest *g = block->Get(i);
+		g->next_free = this->free_list;
+		this->free_list = g;
+	}
+	return true;
+}
+
+/**
+ * Some time has passed, update the animation of the guests at the end of their animation frame.
  * @param delay Number of milliseconds time that have past since the last animation update.
  */
 void Guests::OnAnimate(int delay)
 {
-	for (int i = 0; i < GUEST_BLOCK_SIZE; i++) {
-		Guest *p = this->block.Get(i);
+	this->animation_step = delay;
+	this->due.clear();
+	this->wheel.Advance(delay, &this->due);
+	/* Animate in order of the guest id, as when all guests are visited. */
+	std::sort(this->due.begin(), this->due.end());
+
+	for (uint16 id : this->due) {
+		Guest *p = this->Get(id);
 		if (!p->IsActive()) continue;
 
 		AnimateResult ar = p->OnAnimate(delay);
@@ -142,20 +234,49 @@ void Guests::OnAnimate(int delay)
 	}
 }
 
+/** The visible part of the world changed, animate the walks of guests that became visible frame by frame again. */
+void Guests::OnViewChanged()
+{
+	for (uint i = 0; i < this->GetCapacity(); i++) {
+		Guest *p = this->Get(i);
+		if (p->IsActive() && p->coarse_walk != nullptr && IsVoxelVisible(p->vox_pos)) p->ResumeAnimation();
+	}
+}
+
 /** A new frame arrived, perform the daily call for some of the guests. */
 void Guests::DoTick()
 {
+	int capacity = this->GetCapacity();
 	this->daily_frac++;
-	int end_index = std::min(this->daily_frac * GUEST_BLOCK_SIZE / TICK_COUNT_PER_DAY, GUEST_BLOCK_SIZE);
-	while (this->next_daily_index < end_index) {
-		Guest *p = this->block.Get(this->next_daily_index);
-		if (p->IsActive() && !p->DailyUpdate()) {
-			p->DeActivate(OAR_REMOVE);
-			this->AddFree(p);
+	int end_index = std::min(this->daily_frac * capacity / TICK_COUNT_PER_DAY, capacity);
+	if (this->next_daily_index < end_index) {
+		/* Update chunks of consecutive guests in parallel, and apply their effects afterwards in order of guest id. */
+		int first = this->next_daily_index;
+		uint num_chunks = (end_index - first + DAILY_CHUNK_SIZE - 1) / DAILY_CHUNK_SIZE;
+		if (this->daily_effects.size() < num_chunks) this->daily_effects.resize(num_chunks);
+		_worker_pool.RunJob(num_chunks, [this, first, end_index](uint chunk) {
+			DailyEffects &effects = this->daily_effects[chunk];
+			effects.changed.clear();
+			effects.removed.clear();
+			int last = std::min<int>(first + (chunk + 1) * DAILY_CHUNK_SIZE, end_index);
+			for (int i = first + chunk * DAILY_CHUNK_SIZE; i < last; i++) {
+				Guest *p = this->Get(i);
+				if (p->IsActive() && !p->DailyUpdate(&effects)) effects.removed.push_back(i);
+			}
+		});
+
+		for (uint chunk = 0; chunk < num_chunks; chunk++) {
+			const DailyEffects &effects = this->daily_effects[chunk];
+			for (uint16 id : effects.changed) NotifyChange(WC_GUEST_INFO, id, CHG_DISPLAY_OLD, 0);
+			for (uint16 id : effects.removed) {
+				Guest *p = this->Get(id);
+				p->DeActivate(OAR_REMOVE);
+				this->AddFree(p);
+			}
 		}
-		this->next_daily_index++;
+		this->next_daily_index = end_index;
 	}
-	if (this->next_daily_index >= GUEST_BLOCK_SIZE) {
+	if (this->next_daily_index >= capacity) {
 		this->daily_frac = 0;
 		this->next_daily_index = 0;
 	}
@@ -188,21 +309,23 @@ void Guests::OnNewDay()
  * @param ri Ride being removed.
  */
 void Guests::NotifyRideDeletion(const RideInstance *ri) {
-	for (int i = 0; i < GUEST_BLOCK_SIZE; i++) {
-		Guest *p = this->block.Get(i);
-		if (!p->IsActive()) continue;
+	for (GuestBlock *block : this->blocks) {
+		for (int i = 0; i < GUEST_BLOCK_SIZE; i++) {
+			Guest *p = block->Get(i);
+			if (!p->IsActive()) continue;
 
-		p->NotifyRideDeletion(ri);
+			p->NotifyRideDeletion(ri);
+		}
 	}
 }
 
 /**
- * Return whether there are still non-active guests.
- * @return \c true if there are non-active guests, else \c false.
+ * Return whether there are still non-active guests, or room for adding them.
+ * @return \c true if a non-active guest can be obtained, else \c false.
  */
 bool Guests::HasFreeGuests() const
 {
-	return this->FindNextFreeGuest();
+	return this->free_list != nullptr || this->blocks.size() < MAX_GUEST_BLOCKS;
 }
 
 /**
@@ -211,20 +334,38 @@ bool Guests::HasFreeGuests() const
  */
 void Guests::AddFree(Guest *g)
 {
-	this->free_idx = std::min(this->block.Index(g), this->free_idx);
+	assert(this->active_count > 0);
+	this->wheel.Remove(g->id);
+	g->next_free = this->free_list;
+	this->free_list = g;
+	this->active_count--;
 }
 
 /**
- * Get a non-active guest.
+ * Get a non-active guest, adding a block of guests if needed.
  * @return A non-active guest.
  * @pre #HasFreeGuests() should hold.
  */
 Guest *Guests::GetFree()
 {
-	bool b = this->FindNextFreeGuest();
-	assert(b);
+	if (this->free_list == nullptr) {
+		bool b = this->AddBlock();
+		assert(b);
+	}
 
-	Guest *g = this->block.Get(this->free_idx);
-	this->free_idx++;
+	Guest *g = this->free_list;
+	this->free_list = g->next_free;
+	g->next_free = nullptr;
+	this->active_count++;
 	return g;
 }
+
+/**
+ * Schedule the next animation update of a guest.
+ * @param p %Guest to schedule.
+ * @param duration Number of milliseconds until the update, the update happens at the first animation after that time.
+ */
+void Guests::ScheduleAnimation(const Person *p, uint32 duration)
+{
+	this->wheel.Schedule(p->id, Clamp<uint32>(duration, 1, MAX_ANIMATION_DELAY));
+}
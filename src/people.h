@@ -12,6 +12,8 @@
 #ifndef PEOPLE_H
 #define PEOPLE_H
 
+#include <vector>
+
 static const int GUEST_BLOCK_SIZE = 512; ///< Number of guests in a block.
 
 /** A block of guests. */
@@ -57,54 +59,134 @@ protected:
 	Guest guests[GUEST_BLOCK_SIZE]; ///< Persons in the block.
 };
 
+static const int ANIMATION_WHEEL_BITS = 8; ///< Number of bits of the time used for a level of the #AnimationWheel.
+static const uint ANIMATION_WHEEL_SIZE = 1 << ANIMATION_WHEEL_BITS; ///< Number of slots in a level of the #AnimationWheel.
+static const uint32 MAX_ANIMATION_DELAY = (ANIMATION_WHEEL_SIZE - 1) * ANIMATION_WHEEL_SIZE - 1; ///< Maximal delay of scheduling in the #AnimationWheel.
+static const int32 WHEEL_UNSCHEDULED = -1 - 2 * (int32)ANIMATION_WHEEL_SIZE; ///< Link of a guest that is not in the #AnimationWheel.
+
+/**
+ * Hierarchical timing wheel of the guests waiting for the end of their animation frame, with times in milliseconds.
+ * Guests due within #ANIMATION_WHEEL_SIZE milliseconds are in the first level, with a slot for every millisecond.
+ * Later guests are in the second level, with a slot for every #ANIMATION_WHEEL_SIZE milliseconds. Such a slot is
+ * moved to the first level when its time range starts.
+ * The state of the guests in the wheel is kept in arrays indexed by the guest id, apart from the guests themselves,
+ * so advancing the wheel only touches the guests that become due.
+ */
+class AnimationWheel {
+public:
+	AnimationWheel();
+
+	void SetCapacity(uint capacity);
+	void Schedule(uint id, uint32 delay);
+	void Remove(uint id);
+	void Advance(uint32 delay, std::vector<uint16> *due);
+
+	uint32 now; ///< Current time of the wheel.
+
+private:
+	void Insert(uint id);
+
+	int32 slots[2 * ANIMATION_WHEEL_SIZE]; ///< First guest in each slot of the first and the second level, \c -1 if the slot is empty.
+	std::vector<uint32> wake_time; ///< Time of the next animation update of each guest.
+	std::vector<int32> next;       ///< Next guest in the same slot, \c -1 if it is the last one.
+	std::vector<int32> prev;       ///< Previous guest in the same slot, \c -1 minus the slot index for the first guest, or #WHEEL_UNSCHEDULED.
+};
+
+static const int DAILY_CHUNK_SIZE = 64; ///< Number of consecutive guests in a task of the parallel daily update.
+
+static const uint MAX_GUEST_BLOCKS = 65536 / GUEST_BLOCK_SIZE; ///< Maximal number of guest blocks, limited by the 16 bit #Person::id.
+
 /**
  * All our guests.
- * @todo Allow to have several blocks of guests.
+ * Guests are stored in blocks that are added when all guests are active, the id of a guest is its index in the blocks.
+ * Non-active guests are linked in a free list through #Guest::next_free.
  */
 class Guests {
 public:
 	Guests();
 	~Guests();
 
-	uint CountActiveGuests();
+	/**
+	 * Count the number of active guests.
+	 * @return The number of active guests.
+	 */
+	inline uint CountActiveGuests() const
+	{
+		return this->active_count;
+	}
+
+	/**
+	 * Get the number of guests in the blocks, active or not.
+	 * @return The number of available guest indices.
+	 */
+	inline uint GetCapacity() const
+	{
+		return this->blocks.size() * GUEST_BLOCK_SIZE;
+	}
 
 	/**
 	 * Get a guest from the array.
-	 * @param idx Index of the person (should be between \c 0 and #GUEST_BLOCK_SIZE).
+	 * @param idx Index of the person (should be less than #GetCapacity).
 	 * @return The requested person.
 	 */
 	inline Guest *Get(int idx)
 	{
-		return this->block.Get(idx);
+		assert(idx >= 0 && (uint)idx < this->GetCapacity());
+		return this->blocks[idx / GUEST_BLOCK_SIZE]->Get(idx % GUEST_BLOCK_SIZE);
 	}
 
 	/**
 	 * Get a guest from the array.
-	 * @param idx Index of the person (should be between \c 0 and #GUEST_BLOCK_SIZE).
+	 * @param idx Index of the person (should be less than #GetCapacity).
 	 * @return The requested person.
 	 */
 	inline const Guest *Get(int idx) const
 	{
-		return this->block.Get(idx);
+		assert(idx >= 0 && (uint)idx < this->GetCapacity());
+		return this->blocks[idx / GUEST_BLOCK_SIZE]->Get(idx % GUEST_BLOCK_SIZE);
+	}
+
+	/**
+	 * Get the current time of the animation of the guests.
+	 * @return Time of the #AnimationWheel in milliseconds.
+	 */
+	inline uint32 GetAnimationTime() const
+	{
+		return this->wheel.now;
+	}
+
+	/**
+	 * Get the length of an animation step. The end of an animation frame is handled at the first step at or after it.
+	 * @return Number of milliseconds of the last animation step.
+	 */
+	inline uint32 GetAnimationStep() const
+	{
+		return this->animation_step;
 	}
 
 	void OnAnimate(int delay);
 	void DoTick();
 	void OnNewDay();
+	void OnViewChanged();
 
 	void NotifyRideDeletion(const RideInstance *);
+	void ScheduleAnimation(const Person *p, uint32 duration);
 
 	Point16 start_voxel;  ///< Entry x/y coordinate of the voxel stack at the edge (negative X/Y coordinate means invalid).
 
 private:
-	GuestBlock block;     ///< The data of all actual guests.
-	uint free_idx;        ///< All guests less than this index are active.
+	std::vector<GuestBlock *> blocks; ///< The data of all guests, active or not.
+	Guest *free_list;     ///< First non-active guest, \c nullptr if all guests in the #blocks are active.
+	uint active_count;    ///< Number of active guests.
+	AnimationWheel wheel; ///< Active guests by the end of their animation frame.
+	std::vector<uint16> due; ///< Guests at the end of their animation frame, while animating.
+	uint32 animation_step; ///< Number of milliseconds of the last animation step.
+	std::vector<DailyEffects> daily_effects; ///< Effects of the daily updates of each chunk of guests, while updating.
 	Random rnd;           ///< Random number generator for creating new guests.
 	int daily_frac;       ///< Frame counter.
 	int next_daily_index; ///< Index of the next guest to give daily service.
 
-	bool FindNextFreeGuest();
-	bool FindNextFreeGuest() const;
+	bool AddBlock();
 	bool HasFreeGuests() const;
 	void AddFree(Guest *g);
 	Guest *GetFree();
@@ -0,0 +1,162 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file performance_gui.cpp Window displaying the performance of the recently rendered frames. */
+
+#include "stdafx.h"
+#include "window.h"
+#include "render_stats.h"
+#include "sprite_cache.h"
+#include "video.h"
+
+/**
+ * GUI for viewing the average time spent in the parts of a frame, and the amount of work done.
+ * @ingroup gui_group
+ */
+class PerformanceGui : public GuiWindow {
+public:
+	PerformanceGui();
+
+	void SetWidgetStringParameters(WidgetNumber wid_num) const override;
+	void OnChange(ChangeCode code, uint32 parameter) override;
+
+private:
+	void UpdateMeasurements();
+
+	RenderTimes average;         ///< Average measurements of the last frames, when the window was last updated.
+	SpriteCacheStatistics cache; ///< Statistics of the sprite cache, when the window was last updated.
+};
+
+/**
+ * Widget numbers of the performance GUI.
+ * @ingroup gui_group
+ */
+enum PerformanceWidgets {
+	PERF_GUESTS_DAILY_VALUE,
+	PERF_GUESTS_ANIMATE_VALUE,
+	PERF_RIDES_ANIMATE_VALUE,
+	PERF_REPAINT_VALUE,
+	PERF_COLLECT_VALUE,
+	PERF_SORT_VALUE,
+	PERF_BLIT_VALUE,
+	PERF_PRESENT_VALUE,
+	PERF_SIM_STEPS_VALUE,
+	PERF_SPRITES_VALUE,
+	PERF_GUESTS_VALUE,
+	PERF_PATH_SEARCHES_VALUE,
+	PERF_SPRITE_CACHE_HITS_VALUE,
+	PERF_SPRITE_CACHE_MISSES_VALUE,
+	PERF_SPRITE_CACHE_EVICTIONS_VALUE,
+	PERF_SPRITE_CACHE_MEMORY_VALUE,
+	PERF_TEXT_LAYOUT_HITS_VALUE,
+	PERF_TEXT_LAYOUT_MISSES_VALUE,
+};
+
+#define PERFORMANCE_ROW(id) \
+	Widget(WT_LEFT_TEXT, INVALID_WIDGET_INDEX, COL_RANGE_GREY), \
+		SetPadding(2, 10, 2, 2), \
+		SetData(GUI_PERFORMANCE_ ## id ## _TEXT, STR_NULL), \
+	Widget(WT_RIGHT_TEXT, PERF_ ## id ## _VALUE, COL_RANGE_GREY), \
+		SetMinimalSize(60, 10), \
+		SetPadding(2, 10, 2, 10), \
+		SetData(STR_ARG1, STR_NULL)
+
+static const WidgetPart _performance_gui_parts[] = {
+	Intermediate(0, 1),
+		Intermediate(1, 0),
+			Widget(WT_TITLEBAR, INVALID_WIDGET_INDEX, COL_RANGE_GREY), SetData(GUI_PERFORMANCE_TITLE, GUI_TITLEBAR_TIP),
+			Widget(WT_CLOSEBOX, INVALID_WIDGET_INDEX, COL_RANGE_GREY),
+		EndContainer(),
+		Widget(WT_PANEL, INVALID_WIDGET_INDEX, COL_RANGE_GREY),
+			Intermediate(18, 2), SetPadding(2, 2, 2, 2),
+				PERFORMANCE_ROW(GUESTS_DAILY),
+				PERFORMANCE_ROW(GUESTS_ANIMATE),
+				PERFORMANCE_ROW(RIDES_ANIMATE),
+				PERFORMANCE_ROW(REPAINT),
+				PERFORMANCE_ROW(COLLECT),
+				PERFORMANCE_ROW(SORT),
+				PERFORMANCE_ROW(BLIT),
+				PERFORMANCE_ROW(PRESENT),
+				PERFORMANCE_ROW(SIM_STEPS),
+				PERFORMANCE_ROW(SPRITES),
+				PERFORMANCE_ROW(GUESTS),
+				PERFORMANCE_ROW(PATH_SEARCHES),
+				PERFORMANCE_ROW(SPRITE_CACHE_HITS),
+				PERFORMANCE_ROW(SPRITE_CACHE_MISSES),
+				PERFORMANCE_ROW(SPRITE_CACHE_EVICTIONS),
+				PERFORMANCE_ROW(SPRITE_CACHE_MEMORY),
+				PERFORMANCE_ROW(TEXT_LAYOUT_HITS),
+				PERFORMANCE_ROW(TEXT_LAYOUT_MISSES),
+			EndContainer(),
+	EndContainer(),
+};
+#undef PERFORMANCE_ROW
+
+PerformanceGui::PerformanceGui() : GuiWindow(WC_PERFORMANCE, ALL_WINDOWS_OF_TYPE)
+{
+	this->SetupWidgetTree(_performance_gui_parts, lengthof(_performance_gui_parts));
+	this->UpdateMeasurements();
+}
+
+/** Get the measurements to display, once for all widgets. */
+void PerformanceGui::UpdateMeasurements()
+{
+	this->average = _performance.GetAverage();
+	_sprite_cache.GetStatistics(&this->cache);
+}
+
+void PerformanceGui::SetWidgetStringParameters(WidgetNumber wid_num) const
+{
+	const RenderTimes &avg = this->average;
+	const SpriteCacheStatistics &cache = this->cache;
+	switch (wid_num) {
+		case PERF_GUESTS_DAILY_VALUE:   _str_params.SetNumber(1, avg.steps[SS_GUESTS_DAILY]);   break;
+		case PERF_GUESTS_ANIMATE_VALUE: _str_params.SetNumber(1, avg.steps[SS_GUESTS_ANIMATE]); break;
+		case PERF_RIDES_ANIMATE_VALUE:  _str_params.SetNumber(1, avg.steps[SS_RIDES_ANIMATE]);  break;
+		case PERF_REPAINT_VALUE:        _str_params.SetNumber(1, avg.repaint);                  break;
+		case PERF_COLLECT_VALUE:        _str_params.SetNumber(1, avg.phases[RP_COLLECT]);       break;
+		case PERF_SORT_VALUE:           _str_params.SetNumber(1, avg.phases[RP_SORT]);          break;
+		case PERF_BLIT_VALUE:           _str_params.SetNumber(1, avg.phases[RP_BLIT]);          break;
+		case PERF_PRESENT_VALUE:        _str_params.SetNumber(1, avg.phases[RP_PRESENT]);       break;
+		case PERF_SIM_STEPS_VALUE:      _str_params.SetNumber(1, avg.sim_steps);                break;
+		case PERF_SPRITES_VALUE:        _str_params.SetNumber(1, avg.sprites);                  break;
+		case PERF_GUESTS_VALUE:         _str_params.SetNumber(1, avg.guests);                   break;
+		case PERF_PATH_SEARCHES_VALUE:  _str_params.SetNumber(1, avg.path_searches);            break;
+
+		case PERF_SPRITE_CACHE_HITS_VALUE:      _str_params.SetNumber(1, cache.hits);               break;
+		case PERF_SPRITE_CACHE_MISSES_VALUE:    _str_params.SetNumber(1, cache.misses);             break;
+		case PERF_SPRITE_CACHE_EVICTIONS_VALUE: _str_params.SetNumber(1, cache.evictions);          break;
+		case PERF_SPRITE_CACHE_MEMORY_VALUE:    _str_params.SetNumber(1, cache.memory_used / 1024); break;
+
+		case PERF_TEXT_LAYOUT_HITS_VALUE:   _str_params.SetNumber(1, _video.GetFontCache().layout_hits);   break;
+		case PERF_TEXT_LAYOUT_MISSES_VALUE: _str_params.SetNumber(1, _video.GetFontCache().layout_misses); break;
+	}
+}
+
+void PerformanceGui::OnChange(ChangeCode code, uint32 parameter)
+{
+	if (code == CHG_DISPLAY_OLD) {
+		this->UpdateMeasurements();
+		this->MarkDirty();
+	}
+}
+
+/**
+ * Open the performance window, or close it if it is already open.
+ * @ingroup gui_group
+ */
+void TogglePerformanceGui()
+{
+	Window *w = GetWindowByType(WC_PERFORMANCE, ALL_WINDOWS_OF_TYPE);
+	if (w != nullptr) {
+		_window_manager.DeleteWindow(w);
+		return;
+	}
+	new PerformanceGui;
+}
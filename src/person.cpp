@@ -96,6 +96,7 @@ Person::Person() : VoxelObject(), rnd()
 {
 	this->type = PERSON_INVALID;
 	this->name = nullptr;
+	this->coarse_walk = nullptr;
 
 	this->offset = this->rnd.Uniform(100);
 }
@@ -771,52 +772,150 @@ const WalkInformation *Guest::WalkForActivity(const WalkInformation **walks, uin
  */
 void Person::StartAnimation(const WalkInformation *walk)
 {
+	if (!IsVoxelVisible(this->vox_pos) && this->CompleteWalk(walk)) return;
+
 	const Animation *anim = _sprite_manager.GetAnimation(walk->anim_type, this->type);
 	assert(anim != nullptr && anim->frame_count != 0);
 
 	this->walk = walk;
 	this->frames = anim->frames;
 	this->frame_count = anim->frame_count;
-	this->frame_index = 0;
-	this->frame_time = this->frames[this->frame_index].duration;
+	this->coarse_walk = nullptr;
+	this->SetFrame(0);
 	this->MarkDirty();
 }
 
 /**
- * Mark this person as 'not in use'. (Called by #Guests.)
- * @param ar How to de-activate the person.
+ * Get the time that a frame is displayed when animating frame by frame. The end of a frame is handled at the first
+ * animation step of the #Guests at or after the end of its duration.
+ * @param frame Frame of an animation.
+ * @return Display time of the frame in milliseconds, rounded up to whole animation steps.
  */
-void Person::DeActivate(AnimateResult ar)
+static uint32 GetFrameTime(const AnimationFrame *frame)
 {
-	if (!this->IsActive()) return;
+	uint32 step = _guests.GetAnimationStep();
+	return (std::max<uint32>(frame->duration, 1) + step - 1) / step * step;
+}
 
-	if (ar == OAR_REMOVE && _world.VoxelExists(this->vox_pos)) {
-		/* If not wandered off-world, remove the person from the voxel person list. */
-		this->RemoveSelf(_world.GetCreateVoxel(this->vox_pos, false));
-	}
+/**
+ * Perform the animation sequence at once, for a person that is not visible. The person is moved to the end of the
+ * sequence without animating the frames, and is woken up when the animation of the sequence would have ended.
+ * @param walk Walk information describing the animations to perform.
+ * @return Whether the sequence was performed, else it should be animated frame by frame.
+ */
+bool Person::CompleteWalk(const WalkInformation *walk)
+{
+	WalkProgress progress;
+	this->StartWalkProgress(walk, this->pix_pos, &progress);
+	this->SkipFrames(&progress, MAX_ANIMATION_DELAY);
+	if (!progress.ended) return false; // Too long, or probably never ends, leave it to the animation.
 
-	this->type = PERSON_INVALID;
-	delete[] this->name;
-	this->name = nullptr;
+	this->MarkDirty();
+	this->coarse_walk = walk;
+	this->coarse_pos = this->pix_pos;
+	this->coarse_start = _guests.GetAnimationTime();
+	this->pix_pos = progress.pos;
+	this->walk = progress.walk;
+	this->frames = progress.anim->frames;
+	this->frame_count = progress.anim->frame_count;
+	this->frame_index = progress.index;
+	this->frame_time = progress.anim->frames[progress.index].duration;
+	_guests.ScheduleAnimation(this, progress.time);
+	this->MarkDirty();
+	return true;
 }
 
 /**
- * Update the animation of a person.
- * @param delay Amount of milliseconds since the last update.
- * @return Whether to keep the person active or how to deactivate him/her.
- * @return Result code of the visit.
+ * Continue the walk at the tile of a person that became visible frame by frame, from the frame that the person would
+ * display at this time if the walk had been animated.
  */
-AnimateResult Person::OnAnimate(int delay)
+void Person::ResumeAnimation()
 {
-	this->frame_time -= delay;
-	if (this->frame_time > 0) return OAR_OK;
+	if (this->coarse_walk == nullptr) return;
 
-	this->MarkDirty(); // Marks the entire voxel dirty, which should be big enough even after moving.
+	uint32 elapsed = _guests.GetAnimationTime() - this->coarse_start;
+	WalkProgress progress;
+	this->StartWalkProgress(this->coarse_walk, this->coarse_pos, &progress);
+	this->SkipFrames(&progress, elapsed);
+	if (progress.ended) return; // The walk at the tile ends now.
 
-	if (this->frames == nullptr || this->frame_count == 0) return OAR_REMOVE;
+	this->MarkDirty();
+	this->coarse_walk = nullptr;
+	this->pix_pos = progress.pos;
+	this->walk = progress.walk;
+	this->frames = progress.anim->frames;
+	this->frame_count = progress.anim->frame_count;
+	this->frame_index = progress.index;
+	this->frame_time = this->frames[progress.index].duration;
+	_guests.ScheduleAnimation(this, progress.time + GetFrameTime(&this->frames[progress.index]) - elapsed);
+	this->MarkDirty();
+}
+
+/**
+ * Start performing a walk sequence without displaying its frames.
+ * @param walk Walk information describing the animations to perform.
+ * @param pos Position of the person inside the voxel at the start of the walk.
+ * @param progress [out] Progress at the first frame of the walk.
+ */
+void Person::StartWalkProgress(const WalkInformation *walk, const XYZPoint16 &pos, WalkProgress *progress) const
+{
+	progress->walk = walk;
+	progress->anim = _sprite_manager.GetAnimation(walk->anim_type, this->type);
+	assert(progress->anim != nullptr && progress->anim->frame_count != 0);
+	progress->index = 0;
+	progress->pos = pos;
+	progress->time = 0;
+	progress->ended = false;
+}
+
+/**
+ * Perform frames of the walk at the tile without displaying them, with the same movement and timing as #OnAnimate.
+ * @param progress [inout] Progress of the walk, updated to the first frame that does not end within \a max_time, or to the last frame of the walk at the tile.
+ * @param max_time Maximal time from the start of the walk until the end of the performed frames.
+ */
+void Person::SkipFrames(WalkProgress *progress, uint32 max_time) const
+{
+	static const int MAX_SKIPPED_FRAMES = 1000; // Maximal number of frames performed at once.
+
+	XYZPoint16 ground_pos = progress->pos; // Position after the last frame that did not reach a limit, for the height of the person.
+	bool moved = false;
+	for (int count = 0; count < MAX_SKIPPED_FRAMES; count++) {
+		const AnimationFrame *frame = &progress->anim->frames[progress->index];
+		uint32 frame_time = GetFrameTime(frame);
+		if (progress->time + frame_time > max_time) break;
+
+		progress->time += frame_time;
+		if (!this->MoveFrame(progress->walk, frame, &progress->pos)) {
+			ground_pos = progress->pos;
+			moved = true;
+			progress->index++;
+			if (progress->anim->frame_count <= progress->index) progress->index = 0;
+			continue;
+		}
+
+		if (progress->walk[1].anim_type == ANIM_INVALID) {
+			progress->ended = true;
+			break;
+		}
+		progress->walk++;
+		progress->anim = _sprite_manager.GetAnimation(progress->walk->anim_type, this->type);
+		assert(progress->anim != nullptr && progress->anim->frame_count != 0);
+		progress->index = 0;
+	}
+	if (moved) progress->pos.z = GetZHeight(this->vox_pos, ground_pos.x, ground_pos.y);
+}
 
+/**
+ * Move a person by a frame of a walk.
+ * @param walk Walk being performed.
+ * @param frame Displayed frame of the animation of the walk.
+ * @param pos [inout] Position of the person inside the voxel.
+ * @return Whether the person reached the end of the walk.
+ */
+bool Person::MoveFrame(const WalkInformation *walk, const AnimationFrame *frame, XYZPoint16 *pos) const
+{
 	int16 x_limit = -1;
-	switch (GB(this->walk->limit_type, WLM_X_START, WLM_LIMIT_LENGTH)) {
+	switch (GB(walk->limit_type, WLM_X_START, WLM_LIMIT_LENGTH)) {
 		case WLM_MINIMAL: x_limit =   0;                break;
 		case WLM_LOW:     x_limit = 128 - this->offset; break;
 		case WLM_CENTER:  x_limit = 128;                break;
@@ -825,7 +924,7 @@ AnimateResult Person::OnAnimate(int delay)
 	}
 
 	int16 y_limit = -1;
-	switch (GB(this->walk->limit_type, WLM_Y_START, WLM_LIMIT_LENGTH)) {
+	switch (GB(walk->limit_type, WLM_Y_START, WLM_LIMIT_LENGTH)) {
 		case WLM_MINIMAL: y_limit =   0;                break;
 		case WLM_LOW:     y_limit = 128 - this->offset; break;
 		case WLM_CENTER:  y_limit = 128;                break;
@@ -833,39 +932,85 @@ AnimateResult Person::OnAnimate(int delay)
 		case WLM_MAXIMAL: y_limit = 255;                break;
 	}
 
-	uint16 index = this->frame_index;
-	const AnimationFrame *frame = &this->frames[index];
-	this->pix_pos.x += frame->dx;
-	this->pix_pos.y += frame->dy;
+	pos->x += frame->dx;
+	pos->y += frame->dy;
 
 	bool reached = false; // Set to true when we are beyond the limit!
-	if ((this->walk->limit_type & (1 << WLM_END_LIMIT)) == WLM_X_COND) {
-		if (frame->dx > 0) reached |= this->pix_pos.x > x_limit;
-		if (frame->dx < 0) reached |= this->pix_pos.x < x_limit;
+	if ((walk->limit_type & (1 << WLM_END_LIMIT)) == WLM_X_COND) {
+		if (frame->dx > 0) reached |= pos->x > x_limit;
+		if (frame->dx < 0) reached |= pos->x < x_limit;
 
-		if (y_limit >= 0) this->pix_pos.y += sign(y_limit - this->pix_pos.y); // Also slowly move the other axis in the right direction.
+		if (y_limit >= 0) pos->y += sign(y_limit - pos->y); // Also slowly move the other axis in the right direction.
 	} else {
-		if (frame->dy > 0) reached |= this->pix_pos.y > y_limit;
-		if (frame->dy < 0) reached |= this->pix_pos.y < y_limit;
+		if (frame->dy > 0) reached |= pos->y > y_limit;
+		if (frame->dy < 0) reached |= pos->y < y_limit;
 
-		if (x_limit >= 0) this->pix_pos.x += sign(x_limit - this->pix_pos.x); // Also slowly move the other axis in the right direction.
+		if (x_limit >= 0) pos->x += sign(x_limit - pos->x); // Also slowly move the other axis in the right direction.
 	}
+	return reached;
+}
 
-	if (!reached) {
-		/* Not reached the end, do the next frame. */
-		index++;
-		if (this->frame_count <= index) index = 0;
-		this->frame_index = index;
-		this->frame_time = this->frames[index].duration;
+/**
+ * Display a frame of the current animation, and schedule the next animation update at the end of the frame.
+ * @param index Index of the frame in #frames.
+ */
+void Person::SetFrame(uint16 index)
+{
+	this->frame_index = index;
+	this->frame_time = this->frames[index].duration;
+	_guests.ScheduleAnimation(this, this->frames[index].duration);
+}
 
-		this->pix_pos.z = GetZHeight(this->vox_pos, this->pix_pos.x, this->pix_pos.y);
-		return OAR_OK;
+/**
+ * Mark this person as 'not in use'. (Called by #Guests.)
+ * @param ar How to de-activate the person.
+ */
+void Person::DeActivate(AnimateResult ar)
+{
+	if (!this->IsActive()) return;
+
+	if (ar == OAR_REMOVE && _world.VoxelExists(this->vox_pos)) {
+		/* If not wandered off-world, remove the person from the voxel person list. */
+		this->RemoveSelf(_world.GetCreateVoxel(this->vox_pos, false));
 	}
 
-	/* Reached the goal, start the next walk. */
-	if (this->walk[1].anim_type != ANIM_INVALID) {
-		this->StartAnimation(this->walk + 1);
-		return OAR_OK;
+	this->type = PERSON_INVALID;
+	this->coarse_walk = nullptr;
+	delete[] this->name;
+	this->name = nullptr;
+}
+
+/**
+ * Update the animation of a person, at the end of the displayed frame. (Called by #Guests.)
+ * @param delay Amount of milliseconds since the last update of the animations.
+ * @return Whether to keep the person active or how to deactivate him/her.
+ * @return Result code of the visit.
+ */
+AnimateResult Person::OnAnimate(int delay)
+{
+	this->MarkDirty(); // Marks the entire voxel dirty, which should be big enough even after moving.
+
+	if (this->frames == nullptr || this->frame_count == 0) return OAR_REMOVE;
+
+	if (this->coarse_walk != nullptr) {
+		/* The walk at the tile was already done at once, continue with the next tile. */
+		this->coarse_walk = nullptr;
+	} else {
+		if (!this->MoveFrame(this->walk, &this->frames[this->frame_index], &this->pix_pos)) {
+			/* Not reached the end, do the next frame. */
+			uint16 index = this->frame_index + 1;
+			if (this->frame_count <= index) index = 0;
+			this->SetFrame(index);
+
+			this->pix_pos.z = GetZHeight(this->vox_pos, this->pix_pos.x, this->pix_pos.y);
+			return OAR_OK;
+		}
+
+		/* Reached the goal, start the next walk. */
+		if (this->walk[1].anim_type != ANIM_INVALID) {
+			this->StartAnimation(this->walk + 1);
+			return OAR_OK;
+		}
 	}
 
 	/* Not only the end of this walk, but the end of the entire walk at the tile. */
@@ -973,8 +1118,9 @@ RideVisitDesire Person::WantToVisit(const RideInstance *ri)
 }
 
 /**
- * @fn bool Person::DailyUpdate()
- * Daily ponderings of a person.
+ * @fn bool Person::DailyUpdate(DailyEffects *effects)
+ * Daily ponderings of a person. May run in parallel with other persons, so it should only change the person itself.
+ * @param effects [out] Effects of the update on shared data.
  * @return If \c false, de-activate the person.
  */
 
@@ -994,6 +1140,7 @@ RideVisitDesire Person::WantToVisit(const RideInstance *ri)
 
 Guest::Guest() : Person()
 {
+	this->next_free = nullptr;
 }
 
 Guest::~Guest()
@@ -1085,23 +1232,34 @@ AnimateResult Guest::VisitRideOnAnimate(RideInstance *ri, TileEdge exit_edge)
  */
 void Guest::ChangeHappiness(int16 amount)
 {
-	if (amount == 0) return;
+	if (this->UpdateHappiness(amount)) NotifyChange(WC_GUEST_INFO, this->id, CHG_DISPLAY_OLD, 0);
+}
+
+/**
+ * Update the happiness of the guest, without notifying its window.
+ * @param amount Amount of change.
+ * @return Whether the window of the guest should be notified.
+ */
+bool Guest::UpdateHappiness(int16 amount)
+{
+	if (amount == 0) return false;
 
 	int16 old_happiness = this->happiness;
 	this->happiness = Clamp(this->happiness + amount, 0, 100);
 	if (amount > 0) this->total_happiness = std::min(1000, this->total_happiness + this->happiness - old_happiness);
-	NotifyChange(WC_GUEST_INFO, this->id, CHG_DISPLAY_OLD, 0);
+	return true;
 }
 
 /**
  * Daily ponderings of a guest.
+ * @param effects [out] Effects of the update on shared data.
  * @return If \c false, de-activate the guest.
  * @todo Make going home a bit more random.
  * @todo Implement dropping litter (Guest::has_wrapper) to the path, and also drop the wrapper when passing a non-empty litter bin.
  * @todo Implement nausea (Guest::nausea).
  * @todo Implement energy (for tiredness of guests).
  */
-bool Guest::DailyUpdate()
+bool Guest::DailyUpdate(DailyEffects *effects)
 {
 	assert(this->IsGuest());
 
@@ -1150,7 +1308,7 @@ bool Guest::DailyUpdate()
 		default: NOT_REACHED();
 	}
 
-	this->ChangeHappiness(happiness_change);
+	if (this->UpdateHappiness(happiness_change)) effects->changed.push_back(this->id);
 
 	if (this->activity == GA_WANDER && this->happiness <= 10) this->activity = GA_GO_HOME; // Go home when bored.
 	return true;
@@ -17,6 +17,7 @@
 #include "money.h"
 
 struct WalkInformation;
+class Animation;
 class RideInstance;
 
 /**
@@ -71,6 +72,16 @@ struct WalkInformation {
 	uint8 limit_type;        ///< Limit to end use of this animation. @see WalkLimit
 };
 
+/** Position in the walk at a tile, while performing its frames without displaying them. @see Person::SkipFrames */
+struct WalkProgress {
+	const WalkInformation *walk; ///< Walk animation sequence being performed.
+	const Animation *anim;       ///< Animation of #walk.
+	uint16 index;                ///< Index of the current frame in #anim.
+	XYZPoint16 pos;              ///< Position of the person inside the voxel at the start of the current frame.
+	uint32 time;                 ///< Time from the start of the walk until the start of the current frame.
+	bool ended;                  ///< The current frame is the last frame of the walk at the tile, and #time is the time until its end.
+};
+
 /** Exit codes of the Person::OnAnimate call. */
 enum AnimateResult {
 	OAR_CONTINUE,   ///< No result yet, continue the routine.
@@ -87,6 +98,15 @@ enum RideVisitDesire {
 	RVD_MUST_VISIT, ///< Person wants to visit the ride.
 };
 
+/**
+ * Effects of the daily updates of persons on data shared with other persons or the game, collected while the updates
+ * run in parallel, and applied afterwards in order of person id.
+ */
+struct DailyEffects {
+	std::vector<uint16> changed; ///< Persons with changed data in their window.
+	std::vector<uint16> removed; ///< Persons to de-activate.
+};
+
 /**
  * Class of a person in the world.
  *
@@ -101,7 +121,7 @@ public:
 	const ImageData *GetSprite(const SpriteStorage *sprites, ViewOrientation orient, const Recolouring **recolour) const override;
 
 	virtual AnimateResult OnAnimate(int delay);
-	virtual bool DailyUpdate() = 0;
+	virtual bool DailyUpdate(DailyEffects *effects) = 0;
 
 	virtual void Activate(const Point16 &start, PersonType person_type);
 	virtual void DeActivate(AnimateResult ar);
@@ -124,6 +144,8 @@ public:
 		return this->type == PERSON_GUEST;
 	}
 
+	void ResumeAnimation();
+
 	void SetName(const char *name);
 	const char *GetName() const;
 
@@ -135,7 +157,10 @@ public:
 	const AnimationFrame *frames; ///< Animation frames of the current animation.
 	uint16 frame_count;           ///< Number of frames in #frames.
 	uint16 frame_index;           ///< Currently displayed frame of #frames.
-	int16 frame_time;             ///< Remaining display time of this frame.
+	int16 frame_time;             ///< Display time of this frame, the end is scheduled in the #AnimationWheel of the #Guests.
+	const WalkInformation *coarse_walk; ///< First walk sequence that was done at once while the person was not visible, the wake up is at the end of the walk at the tile. \c nullptr if the frames are animated.
+	XYZPoint16 coarse_pos;        ///< Position of the person inside the voxel at the start of #coarse_walk.
+	uint32 coarse_start;          ///< Animation time of the #Guests at the start of #coarse_walk.
 	Recolouring recolour;         ///< Person recolouring.
 
 protected:
@@ -147,6 +172,11 @@ protected:
 
 	virtual void DecideMoveDirection() = 0;
 	void StartAnimation(const WalkInformation *walk);
+	bool CompleteWalk(const WalkInformation *walk);
+	void StartWalkProgress(const WalkInformation *walk, const XYZPoint16 &pos, WalkProgress *progress) const;
+	void SkipFrames(WalkProgress *progress, uint32 max_time) const;
+	bool MoveFrame(const WalkInformation *walk, const AnimationFrame *frame, XYZPoint16 *pos) const;
+	void SetFrame(uint16 index);
 
 	virtual RideVisitDesire WantToVisit(const RideInstance *ri);
 	virtual AnimateResult EdgeOfWorldOnAnimate() = 0;
@@ -172,9 +202,10 @@ public:
 	void DeActivate(AnimateResult ar) override;
 
 	AnimateResult OnAnimate(int delay) override;
-	bool DailyUpdate() override;
+	bool DailyUpdate(DailyEffects *effects) override;
 
 	void ChangeHappiness(int16 amount);
+	bool UpdateHappiness(int16 amount);
 	ItemType SelectItem(const RideInstance *ri);
 	void BuyItem(RideInstance *ri);
 	void NotifyRideDeletion(const RideInstance *ri);
@@ -201,6 +232,8 @@ public:
 	uint8 waste;         ///< Amount of food/drink waste that should be disposed.
 	uint8 nausea;        ///< Amount of nausea of the guest.
 
+	Guest *next_free;    ///< Next guest in the list of non-active guests of #Guests, only valid while not active.
+
 protected:
 	void DecideMoveDirection() override;
 	RideVisitDesire ComputeExitDesire(TileEdge current_edge, XYZPoint16 cur_pos, TileEdge exit_edge, bool *seen_wanted_ride);
@@ -188,6 +188,27 @@ static const char *_gui_string_names[] = {
 	"SETTING_LANGUAGE_TOOLTIP",
 	"SETTING_RESOLUTION",
 	"SETTING_RESOLUTION_TOOLTIP",
+
+	/* Performance window. */
+	"PERFORMANCE_TITLE",
+	"PERFORMANCE_GUESTS_DAILY_TEXT",
+	"PERFORMANCE_GUESTS_ANIMATE_TEXT",
+	"PERFORMANCE_RIDES_ANIMATE_TEXT",
+	"PERFORMANCE_REPAINT_TEXT",
+	"PERFORMANCE_COLLECT_TEXT",
+	"PERFORMANCE_SORT_TEXT",
+	"PERFORMANCE_BLIT_TEXT",
+	"PERFORMANCE_PRESENT_TEXT",
+	"PERFORMANCE_SIM_STEPS_TEXT",
+	"PERFORMANCE_SPRITES_TEXT",
+	"PERFORMANCE_GUESTS_TEXT",
+	"PERFORMANCE_PATH_SEARCHES_TEXT",
+	"PERFORMANCE_SPRITE_CACHE_HITS_TEXT",
+	"PERFORMANCE_SPRITE_CACHE_MISSES_TEXT",
+	"PERFORMANCE_SPRITE_CACHE_EVICTIONS_TEXT",
+	"PERFORMANCE_SPRITE_CACHE_MEMORY_TEXT",
+	"PERFORMANCE_TEXT_LAYOUT_HITS_TEXT",
+	"PERFORMANCE_TEXT_LAYOUT_MISSES_TEXT",
 };
 
 /** String names of the shops. */
@@ -0,0 +1,166 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file render_stats.cpp Measuring the time spent in the phases of rendering and simulation. */
+
+#include "stdafx.h"
+#include "render_stats.h"
+
+RenderTimes _render_times; ///< Time spent in the phases of rendering and simulation.
+PerformanceMonitor _performance; ///< Measurements of the recently rendered frames.
+
+/** Set the time of all phases and steps, and all counts back to zero. */
+void RenderTimes::Reset()
+{
+	for (int i = 0; i < RP_COUNT; i++) this->phases[i] = 0;
+	for (int i = 0; i < SS_COUNT; i++) this->steps[i] = 0;
+	this->repaint = 0;
+	this->sim_steps = 0;
+	this->sprites = 0;
+	this->path_searches = 0;
+	this->guests = 0;
+}
+
+/**
+ * Start measuring a phase.
+ * @param phase Phase to measure.
+ */
+PhaseTimer::PhaseTimer(RenderPhase phase)
+{
+	this->phase = phase;
+	this->start = Clock::now();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+	this->Stop();
+}
+
+/**
+ * Stop measuring the current phase, and start measuring another phase.
+ * @param phase Next phase to measure.
+ */
+void PhaseTimer::Switch(RenderPhase phase)
+{
+	this->Stop();
+	this->phase = phase;
+	this->start = Clock::now();
+}
+
+/** Stop measuring, and add the time of the phase to #_render_times. */
+void PhaseTimer::Stop()
+{
+	if (this->phase == RP_COUNT) return;
+
+	Clock::duration elapsed = Clock::now() - this->start;
+	_render_times.phases[this->phase] += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+	this->phase = RP_COUNT;
+}
+
+/**
+ * Start measuring a simulation step.
+ * @param step Step to measure.
+ */
+StepTimer::StepTimer(SimulationStep step)
+{
+	this->step = step;
+	this->start = std::chrono::steady_clock::now();
+}
+
+/** Stop measuring, and add the time of the step to #_render_times. */
+StepTimer::~StepTimer()
+{
+	std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - this->start;
+	_render_times.steps[this->step] += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+PerformanceMonitor::PerformanceMonitor()
+{
+	this->frame_count = 0;
+	this->log = nullptr;
+	for (uint i = 0; i < HISTORY_LENGTH; i++) this->history[i].Reset();
+}
+
+PerformanceMonitor::~PerformanceMonitor()
+{
+	this->CloseLog();
+}
+
+/**
+ * Start logging the measurements of every frame to a CSV file.
+ * @param fname Name of the file.
+ * @return Whether the file could be opened.
+ */
+bool PerformanceMonitor::OpenLog(const char *fname)
+{
+	this->CloseLog();
+	this->log = fopen(fname, "w");
+	if (this->log == nullptr) return false;
+
+	fprintf(this->log, "frame,repaint_us,collect_us,sort_us,blit_us,present_us,guests_daily_us,guests_animate_us,rides_animate_us,");
+	fprintf(this->log, "sim_steps,sprites,guests,path_searches\n");
+	return true;
+}
+
+/** Stop logging the measurements of the frames. */
+void PerformanceMonitor::CloseLog()
+{
+	if (this->log == nullptr) return;
+
+	fclose(this->log);
+	this->log = nullptr;
+}
+
+/** A frame has been rendered, store its measurements from #_render_times, and start measuring the next frame. */
+void PerformanceMonitor::EndFrame()
+{
+	const RenderTimes &rt = _render_times;
+	if (this->log != nullptr) {
+		fprintf(this->log, "%llu,%llu", (unsigned long long)this->frame_count, (unsigned long long)rt.repaint);
+		for (int i = 0; i < RP_COUNT; i++) fprintf(this->log, ",%llu", (unsigned long long)rt.phases[i]);
+		for (int i = 0; i < SS_COUNT; i++) fprintf(this->log, ",%llu", (unsigned long long)rt.steps[i]);
+		fprintf(this->log, ",%u,%u,%u,%u\n", rt.sim_steps, rt.sprites, rt.guests, rt.path_searches);
+	}
+
+	this->history[this->frame_count % HISTORY_LENGTH] = rt;
+	this->frame_count++;
+	_render_times.Reset();
+}
+
+/**
+ * Get the average measurements of the most recent frames.
+ * @return Average of the frames in the history, all zero if there are none.
+ */
+RenderTimes PerformanceMonitor::GetAverage() const
+{
+	RenderTimes avg;
+	avg.Reset();
+	uint count = std::min<uint64>(this->frame_count, HISTORY_LENGTH);
+	if (count == 0) return avg;
+
+	uint64 sums[4] = {0, 0, 0, 0};
+	for (uint f = 0; f < count; f++) {
+		const RenderTimes &rt = this->history[f];
+		for (int i = 0; i < RP_COUNT; i++) avg.phases[i] += rt.phases[i];
+		for (int i = 0; i < SS_COUNT; i++) avg.steps[i] += rt.steps[i];
+		avg.repaint += rt.repaint;
+		sums[0] += rt.sim_steps;
+		sums[1] += rt.sprites;
+		sums[2] += rt.path_searches;
+		sums[3] += rt.guests;
+	}
+	for (int i = 0; i < RP_COUNT; i++) avg.phases[i] /= count;
+	for (int i = 0; i < SS_COUNT; i++) avg.steps[i] /= count;
+	avg.repaint /= count;
+	avg.sim_steps = sums[0] / count;
+	avg.sprites = sums[1] / count;
+	avg.path_searches = sums[2] / count;
+	avg.guests = sums[3] / count;
+	return avg;
+}
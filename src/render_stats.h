@@ -0,0 +1,106 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file render_stats.h Measuring the time spent in the phases of rendering and simulation. */
+
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <chrono>
+
+/** Phases of rendering the display. */
+enum RenderPhase {
+	RP_COLLECT, ///< Collecting the sprites to draw.
+	RP_SORT,    ///< Ordering the sprites by viewing distance.
+	RP_BLIT,    ///< Blitting sprites and copying pre-rendered pixels.
+	RP_PRESENT, ///< Handing the finished display to the video driver.
+
+	RP_COUNT,   ///< Number of render phases.
+};
+
+/** Steps of simulating the game. */
+enum SimulationStep {
+	SS_GUESTS_DAILY,   ///< Daily updates of the guests, spread over the frames of a day (#Guests::DoTick).
+	SS_GUESTS_ANIMATE, ///< Moving the guests (#Guests::OnAnimate).
+	SS_RIDES_ANIMATE,  ///< Moving the rides (#RidesManager::OnAnimate).
+
+	SS_COUNT,          ///< Number of simulation steps.
+};
+
+/** Time spent in the phases of rendering and in the steps of the simulation, and counts of the work done, since the last #Reset. */
+struct RenderTimes {
+	void Reset();
+
+	uint64 phases[RP_COUNT]; ///< Time spent in each phase, in microseconds.
+	uint64 steps[SS_COUNT];  ///< Time spent in each simulation step, in microseconds.
+	uint64 repaint;          ///< Time spent repainting the windows (#UpdateWindows), in microseconds.
+	uint32 sim_steps;        ///< Number of simulation steps.
+	uint32 sprites;          ///< Number of drawn sprites.
+	uint32 path_searches;    ///< Number of searched paths.
+	uint32 guests;           ///< Number of active guests, set at the end of a frame.
+};
+
+/**
+ * Measure the time spent in a render phase, from construction until #Stop or destruction.
+ * The time is added to #_render_times, so timers should only be used by the main thread.
+ */
+class PhaseTimer {
+public:
+	PhaseTimer(RenderPhase phase);
+	~PhaseTimer();
+
+	void Switch(RenderPhase phase);
+	void Stop();
+
+private:
+	/** Clock used for the measurements. */
+	typedef std::chrono::steady_clock Clock;
+
+	RenderPhase phase;        ///< Phase being measured, #RP_COUNT if stopped.
+	Clock::time_point start;  ///< Start of the measurement.
+};
+
+/** Measure the time spent in a simulation step, from construction until destruction. Only for use by the main thread. */
+class StepTimer {
+public:
+	StepTimer(SimulationStep step);
+	~StepTimer();
+
+private:
+	SimulationStep step; ///< Step being measured.
+	std::chrono::steady_clock::time_point start; ///< Start of the measurement.
+};
+
+/**
+ * Measurements of the recently rendered frames, for the performance window, and optionally a log of all frames.
+ * A frame consists of the repaint of the display and of the simulation steps since the previous frame.
+ */
+class PerformanceMonitor {
+public:
+	PerformanceMonitor();
+	~PerformanceMonitor();
+
+	bool OpenLog(const char *fname);
+	void CloseLog();
+	void EndFrame();
+	RenderTimes GetAverage() const;
+
+	static const uint HISTORY_LENGTH = 32; ///< Number of frames in the #history.
+
+	uint64 frame_count; ///< Number of ended frames.
+
+private:
+	RenderTimes history[HISTORY_LENGTH]; ///< Measurements of the most recent frames, used as a ring buffer.
+	FILE *log;                           ///< File receiving a CSV line for every frame, \c nullptr if not logging.
+};
+
+extern RenderTimes _render_times;
+extern PerformanceMonitor _performance;
+
+#endif
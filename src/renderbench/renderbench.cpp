@@ -0,0 +1,341 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file renderbench.cpp Benchmark of rendering the main display without a window. */
+
+#include "../stdafx.h"
+#include "../video.h"
+#include "../viewport.h"
+#include "../window.h"
+#include "../map.h"
+#include "../rcdfile.h"
+#include "../sprite_data.h"
+#include "../sprite_cache.h"
+#include "../sprite_store.h"
+#include "../config_reader.h"
+#include "../language.h"
+#include "../getoptdata.h"
+#include "../fileio.h"
+#include "../gamecontrol.h"
+#include "../loadsave.h"
+#include "../worker_pool.h"
+#include "../render_stats.h"
+#include "../math_func.h"
+#include "../blit_kernels.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+void InitMouseModes();
+
+static const int SWEEP_ROWS = 4; ///< Number of passes over the park in a sweep of the view.
+static const uint KERNEL_CHECK_RUNS = 100000; ///< Number of random runs of pixels to check with each blit kernel.
+
+/** Command-line options of the benchmark. */
+static const OptionData _options[] = {
+	GETOPT_NOVAL('h', "--help"),
+	GETOPT_VALUE('f', "--frames"),
+	GETOPT_VALUE('r', "--resolution"),
+	GETOPT_VALUE('o', "--output"),
+	GETOPT_VALUE('z', "--zoom"),
+	GETOPT_NOVAL('n', "--no-simd"),
+	GETOPT_NOVAL('k', "--check-kernels"),
+	GETOPT_END()
+};
+
+/** Output command-line help. */
+static void PrintUsage()
+{
+	printf("Usage: freerct-renderbench [options] [savegame]\n");
+	printf("Renders the park (or the default new park) while sweeping the view across it in all four directions of view.\n");
+	printf("A relative savegame path is relative to the directory of the program.\n");
+	printf("Options:\n");
+	printf("  -h, --help                 Display this help text and exit\n");
+	printf("  -f, --frames <count>       Number of frames for each direction of view (default 200)\n");
+	printf("  -r, --resolution <w>x<h>   Size of the display (default 1024x768)\n");
+	printf("  -o, --output <file>        Write the times of every frame to a CSV file\n");
+	printf("  -z, --zoom <width>         Width of a tile in the view, 64, 32, or 16 (default 64)\n");
+	printf("  -n, --no-simd              Blit with the generic code instead of the vectorized kernels\n");
+	printf("  -k, --check-kernels        Check that the vectorized kernels give the same pixels as the generic code, and exit\n");
+}
+
+/** Measurements of a rendered frame. */
+struct FrameTimes {
+	int orientation;         ///< Direction of view of the frame.
+	uint64 total;            ///< Time of rendering the whole frame, in microseconds.
+	uint64 phases[RP_COUNT]; ///< Time spent in each phase of rendering, in microseconds.
+};
+
+/** Names of the render phases in the report. */
+static const char *_phase_names[RP_COUNT] = {"collect", "sort", "blit", "present"};
+
+/**
+ * Move the view to a point of the sweep across the park.
+ * The sweep consists of #SWEEP_ROWS passes along the x axis, alternating in direction.
+ * @param vp %Viewport to move.
+ * @param pos Position in the sweep, between \c 0 (start) and \c 1 (end).
+ */
+static void SetSweepPosition(Viewport *vp, double pos)
+{
+	int32 x_size = _world.GetXSize() * 256;
+	int32 y_size = _world.GetYSize() * 256;
+
+	int row = std::min(static_cast<int>(pos * SWEEP_ROWS), SWEEP_ROWS - 1);
+	double along = pos * SWEEP_ROWS - row;
+	if ((row & 1) != 0) along = 1.0 - along;
+
+	vp->view_pos.x = Clamp<int32>(static_cast<int32>(along * x_size), 0, x_size - 1);
+	vp->view_pos.y = Clamp<int32>((2 * row + 1) * y_size / (2 * SWEEP_ROWS), 0, y_size - 1);
+	vp->MarkDirty();
+}
+
+/**
+ * Render a frame of the display, and measure the time of its phases.
+ * @param orientation Direction of view of the frame.
+ * @return Measurements of the frame.
+ */
+static FrameTimes RenderFrame(int orientation)
+{
+	_render_times.Reset();
+	auto start = std::chrono::steady_clock::now();
+	UpdateWindows();
+	auto end = std::chrono::steady_clock::now();
+
+	FrameTimes ft;
+	ft.orientation = orientation;
+	ft.total = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+	for (int i = 0; i < RP_COUNT; i++) ft.phases[i] = _render_times.phases[i];
+	return ft;
+}
+
+/**
+ * Print statistics of the frame times.
+ * @param title Description of the frames.
+ * @param frames Measurements of the frames, must not be empty.
+ */
+static void PrintStatistics(const char *title, const std::vector<const FrameTimes *> &frames)
+{
+	std::vector<uint64> totals;
+	uint64 sum = 0;
+	uint64 phase_sums[RP_COUNT] = {};
+	for (const FrameTimes *ft : frames) {
+		totals.push_back(ft->total);
+		sum += ft->total;
+		for (int i = 0; i < RP_COUNT; i++) phase_sums[i] += ft->phases[i];
+	}
+	std::sort(totals.begin(), totals.end());
+
+	double count = frames.size();
+	printf("%-12s %6u frames  mean %8.3f ms  median %8.3f ms  p95 %8.3f ms  max %8.3f ms\n", title, (uint)frames.size(),
+			sum / count / 1000.0, totals[totals.size() / 2] / 1000.0, totals[totals.size() * 95 / 100] / 1000.0, totals.back() / 1000.0);
+
+	uint64 other = sum;
+	printf("%12s", "");
+	for (int i = 0; i < RP_COUNT; i++) {
+		printf("  %s %7.3f ms", _phase_names[i], phase_sums[i] / count / 1000.0);
+		other -= std::min(other, phase_sums[i]);
+	}
+	printf("  other %7.3f ms\n", other / count / 1000.0);
+}
+
+/**
+ * Write the measurements of all frames to a CSV file.
+ * @param fname Name of the file.
+ * @param frames Measurements of the frames.
+ * @return Whether writing succeeded.
+ */
+static bool WriteCsv(const char *fname, const std::vector<FrameTimes> &frames)
+{
+	FILE *fp = fopen(fname, "w");
+	if (fp == nullptr) return false;
+
+	fprintf(fp, "frame,orientation,total_us");
+	for (int i = 0; i < RP_COUNT; i++) fprintf(fp, ",%s_us", _phase_names[i]);
+	fprintf(fp, "\n");
+	for (uint f = 0; f < frames.size(); f++) {
+		fprintf(fp, "%u,%d,%llu", f, frames[f].orientation, (unsigned long long)frames[f].total);
+		for (int i = 0; i < RP_COUNT; i++) fprintf(fp, ",%llu", (unsigned long long)frames[f].phases[i]);
+		fprintf(fp, "\n");
+	}
+	fclose(fp);
+	return true;
+}
+
+/**
+ * Main entry point of the rendering benchmark.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return The exit code of the program.
+ */
+int main(int argc, char **argv)
+{
+	GetOptData opt_data(argc - 1, argv + 1, _options);
+	int num_frames = 200;
+	Point32 resolution(1024, 768);
+	const char *csv_file = nullptr;
+	int tile_width = 64;
+	bool allow_simd = true;
+	bool check_kernels = false;
+
+	int opt_id;
+	do {
+		opt_id = opt_data.GetOpt();
+		switch (opt_id) {
+			case 'h':
+				PrintUsage();
+				return 0;
+
+			case 'f':
+				num_frames = atoi(opt_data.opt);
+				if (num_frames <= 0) {
+					fprintf(stderr, "ERROR: Number of frames must be positive\n");
+					return 1;
+				}
+				break;
+
+			case 'r':
+				if (sscanf(opt_data.opt, "%dx%d", &resolution.x, &resolution.y) != 2 || resolution.x < 120 || resolution.y < 120) {
+					fprintf(stderr, "ERROR: Bad resolution \"%s\"\n", opt_data.opt);
+					return 1;
+				}
+				break;
+
+			case 'o':
+				csv_file = opt_data.opt;
+				break;
+
+			case 'z':
+				tile_width = atoi(opt_data.opt);
+				if (tile_width != 64 && tile_width != 32 && tile_width != 16) {
+					fprintf(stderr, "ERROR: Bad tile width \"%s\"\n", opt_data.opt);
+					return 1;
+				}
+				break;
+
+			case 'n':
+				allow_simd = false;
+				break;
+
+			case 'k':
+				check_kernels = true;
+				break;
+
+			case -1:
+				break;
+
+			default:
+				fprintf(stderr, "ERROR while processing the command-line\n");
+				return 1;
+		}
+	} while (opt_id != -1);
+	const char *savegame = (opt_data.numleft > 0) ? opt_data.argv[0] : nullptr;
+
+	if (check_kernels) {
+		SelectBlitKernels(allow_simd);
+		uint failures = CheckBlitKernels(KERNEL_CHECK_RUNS);
+		printf("Checked %u runs of pixels with the %s blit kernels: %u different\n", KERNEL_CHECK_RUNS, _blit_kernels.name, failures);
+		return (failures == 0) ? 0 : 1;
+	}
+
+	ConfigFile cfg_file;
+
+	ChangeWorkingDirectoryToExecutable(argv[0]);
+
+	_rcd_collection.ScanDirectories();
+	_sprite_manager.LoadRcdFiles();
+
+	InitLanguage();
+
+	if (!_gui_sprites.HasSufficientGraphics()) {
+		fprintf(stderr, "Insufficient graphics loaded.\n");
+		return 1;
+	}
+
+	cfg_file.Load("freerct.cfg");
+	const char *font_path = cfg_file.GetValue("font", "medium-path");
+	int font_size = cfg_file.GetNum("font", "medium-size");
+	if (font_path == nullptr || *font_path == '\0' || font_size == -1) {
+		fprintf(stderr, "Failed to find font settings in 'freerct.cfg'.\n");
+		return 1;
+	}
+
+	int sprite_cache_size = cfg_file.GetNum("video", "sprite-cache-size");
+	if (sprite_cache_size >= 0) _sprite_cache.SetMemoryLimit(static_cast<size_t>(sprite_cache_size) * 1024 * 1024);
+
+	std::string err = _video.Initialize(font_path, font_size, true);
+	if (!err.empty()) {
+		fprintf(stderr, "Failed to initialize the video system (%s), aborting\n", err.c_str());
+		return 1;
+	}
+
+	SelectBlitKernels(allow_simd);
+	_worker_pool.Initialize(0);
+	InitMouseModes();
+
+	StartNewGame();
+	if (savegame != nullptr && !LoadGame(savegame)) {
+		fprintf(stderr, "Failed to load \"%s\", aborting\n", savegame);
+		return 1;
+	}
+	_video.SetResolution(resolution);
+
+	Viewport *vp = GetViewport();
+	assert(vp != nullptr);
+	while (vp->tile_width > tile_width) vp->Zoom(-1);
+
+	std::vector<FrameTimes> frames;
+	frames.reserve(4 * num_frames);
+	for (int orient = 0; orient < VOR_NUM_ORIENT; orient++) {
+		for (int f = 0; f < num_frames; f++) {
+			SetSweepPosition(vp, (num_frames > 1) ? f / (double)(num_frames - 1) : 0.0);
+			frames.push_back(RenderFrame(vp->orientation));
+		}
+		vp->Rotate(1);
+	}
+
+	printf("Rendered %d frames at %dx%d with tile width %d using %u threads and the %s blit kernels\n", (int)frames.size(), resolution.x, resolution.y,
+			vp->tile_width, _worker_pool.GetThreadCount(), _blit_kernels.name);
+	static const char *orient_names[VOR_NUM_ORIENT] = {"north", "east", "south", "west"};
+	std::vector<const FrameTimes *> selection;
+	for (int orient = 0; orient < VOR_NUM_ORIENT; orient++) {
+		selection.clear();
+		for (const FrameTimes &ft : frames) {
+			if (ft.orientation == orient) selection.push_back(&ft);
+		}
+		if (!selection.empty()) PrintStatistics(orient_names[orient], selection);
+	}
+	selection.clear();
+	for (const FrameTimes &ft : frames) selection.push_back(&ft);
+	PrintStatistics("all", selection);
+
+	printf("Image memory:\n");
+	for (const ImageArena *arena : _image_arenas) {
+		printf("  %9.1f KiB used  %9.1f KiB reserved  %5u images  %s\n", arena->used / 1024.0, arena->reserved / 1024.0,
+				(uint)arena->images.size(), arena->name.c_str());
+	}
+
+	SpriteCacheStatistics cache;
+	_sprite_cache.GetStatistics(&cache);
+	printf("Sprite cache:\n");
+	printf("  %9llu hits  %9llu misses  %9llu evictions  %6u sprites  %9.1f KiB used\n", (unsigned long long)cache.hits,
+			(unsigned long long)cache.misses, (unsigned long long)cache.evictions, (uint)cache.entries, cache.memory_used / 1024.0);
+
+	const FontCache &font_cache = _video.GetFontCache();
+	printf("Text layouts:\n");
+	printf("  %9llu hits  %9llu misses\n", (unsigned long long)font_cache.layout_hits, (unsigned long long)font_cache.layout_misses);
+
+	if (csv_file != nullptr && !WriteCsv(csv_file, frames)) fprintf(stderr, "Failed to write \"%s\"\n", csv_file);
+
+	ShutdownGame();
+	UninitLanguage();
+	DestroyImageStorage();
+	_worker_pool.Shutdown();
+	_video.Shutdown();
+	return 0;
+}
@@ -0,0 +1,224 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file sprite_cache.cpp Cache of decoded sprites. */
+
+#include "stdafx.h"
+#include "sprite_cache.h"
+#include "sprite_data.h"
+#include "bitmath.h"
+
+static const size_t DEFAULT_SPRITE_CACHE_SIZE = 32 * 1024 * 1024; ///< Default memory limit of the sprite cache in bytes.
+
+SpriteCache _sprite_cache; ///< Cache of decoded sprites.
+
+/**
+ * Decode an 8bpp sprite.
+ * @param spr Sprite to decode.
+ * @param recoloured Shifted palette to use, or \c nullptr if the sprite has no pixels that need recolouring.
+ */
+DecodedSprite::DecodedSprite(const ImageData *spr, const uint8 *recoloured)
+{
+	assert(GB(spr->flags, IFG_IS_8BPP, 1) != 0);
+
+	this->width = spr->width;
+	this->height = spr->height;
+	this->rows.reserve(spr->height + 1);
+	for (int yoff = 0; yoff < spr->height; yoff++) {
+		this->rows.push_back(this->spans.size());
+
+		uint32 offset = spr->table[yoff];
+		if (offset == INVALID_JUMP) continue;
+
+		uint16 xpos = 0;
+		for (;;) {
+			uint8 rel_off = spr->data[offset];
+			uint8 count   = spr->data[offset + 1];
+			const uint8 *pixels = &spr->data[offset + 2];
+			offset += 2 + count;
+
+			xpos += rel_off & 127;
+			if (count > 0) {
+				this->spans.push_back({xpos, count, static_cast<uint32>(this->pixels.size())});
+				if (recoloured != nullptr) {
+					for (int i = 0; i < count; i++) this->pixels.push_back(_palette[recoloured[pixels[i]]]);
+				} else {
+					for (int i = 0; i < count; i++) this->pixels.push_back(_palette[pixels[i]]);
+				}
+				xpos += count;
+			}
+			if ((rel_off & 128) != 0) break;
+		}
+	}
+	this->rows.push_back(this->spans.size());
+
+	this->rows.shrink_to_fit();
+	this->spans.shrink_to_fit();
+	this->pixels.shrink_to_fit();
+}
+
+/**
+ * Get the amount of memory used by the decoded sprite.
+ * @return Size of the decoded sprite in bytes.
+ */
+size_t DecodedSprite::GetMemorySize() const
+{
+	return sizeof(*this) + this->rows.size() * sizeof(uint32) + this->spans.size() * sizeof(DecodedSpan) + this->pixels.size() * sizeof(uint32);
+}
+
+/**
+ * Construct the key of a decoded sprite.
+ * @param spr Sprite to decode.
+ * @param recolour Sprite recolouring definition.
+ * @param shift Gradient shift.
+ */
+SpriteCacheKey::SpriteCacheKey(const ImageData *spr, const Recolouring &recolour, GradientShift shift)
+{
+	this->sprite = spr;
+	this->recolour = 0;
+	this->shift = GS_NORMAL;
+	if (GB(spr->flags, IFG_RECOLOUR, 1) == 0) return; // Sprite looks the same with every recolouring and gradient shift.
+
+	this->recolour = recolour.GetKey();
+	this->shift = shift;
+}
+
+/**
+ * Order of keys in the cache.
+ * @param other Key to compare with.
+ * @return Whether this key is ordered before \a other.
+ */
+bool SpriteCacheKey::operator<(const SpriteCacheKey &other) const
+{
+	if (this->sprite != other.sprite) return this->sprite < other.sprite;
+	if (this->recolour != other.recolour) return this->recolour < other.recolour;
+	return this->shift < other.shift;
+}
+
+/**
+ * Compute the hash of the key, to select the shard of the cache.
+ * @return Hash value of the key.
+ */
+uint SpriteCacheKey::GetHash() const
+{
+	uint64 hash = (reinterpret_cast<uintptr_t>(this->sprite) >> 4) ^ (this->recolour * 0x9E3779B97F4A7C15ULL) ^ this->shift;
+	return static_cast<uint>(hash ^ (hash >> 32));
+}
+
+SpriteCache::SpriteCache()
+{
+	this->memory_limit = DEFAULT_SPRITE_CACHE_SIZE;
+	for (SpriteCacheShard &shard : this->shards) shard.stats = {0, 0, 0, 0, 0};
+}
+
+/**
+ * Get a decoded sprite, decoding it if it is not in the cache.
+ * @param spr 8bpp sprite to get.
+ * @param recolour Sprite recolouring definition.
+ * @param shift Gradient shift.
+ * @return The decoded sprite, or \c nullptr if the cache is disabled.
+ * @note For sprites with #IFG_RECOLOUR, the palette of \a recolour must already be computed for \a shift
+ *       (see Recolouring::GetPalette) when used from several threads. Other sprites do not use \a recolour.
+ */
+std::shared_ptr<const DecodedSprite> SpriteCache::Get(const ImageData *spr, const Recolouring &recolour, GradientShift shift)
+{
+	size_t limit = this->memory_limit / SPRITE_CACHE_SHARDS;
+	if (limit == 0) return nullptr;
+
+	SpriteCacheKey key(spr, recolour, shift);
+	SpriteCacheShard &shard = this->shards[key.GetHash() % SPRITE_CACHE_SHARDS];
+	{
+		std::lock_guard<std::mutex> guard(shard.lock);
+		auto iter = shard.index.find(key);
+		if (iter != shard.index.end()) {
+			shard.stats.hits++;
+			shard.usage.splice(shard.usage.begin(), shard.usage, iter->second);
+			return iter->second->second;
+		}
+		shard.stats.misses++;
+	}
+
+	/* Decode without holding the lock, other threads may use the shard meanwhile.
+	 * Only recoloured sprites use the palette of the recolouring, other sprites look the same with every recolouring and gradient shift. */
+	const uint8 *recoloured = (GB(spr->flags, IFG_RECOLOUR, 1) != 0) ? recolour.GetPalette(shift) : nullptr;
+	std::shared_ptr<const DecodedSprite> decoded = std::make_shared<const DecodedSprite>(spr, recoloured);
+	size_t size = decoded->GetMemorySize();
+	if (size > limit) return decoded; // Too big to cache.
+
+	std::lock_guard<std::mutex> guard(shard.lock);
+	auto iter = shard.index.find(key);
+	if (iter != shard.index.end()) return iter->second->second; // Another thread decoded it as well.
+
+	ReduceMemory(&shard, limit - size);
+	shard.usage.emplace_front(key, decoded);
+	shard.index.emplace(key, shard.usage.begin());
+	shard.stats.entries++;
+	shard.stats.memory_used += size;
+	return decoded;
+}
+
+/**
+ * Drop least recently used decoded sprites of a shard until it uses at most \a limit bytes.
+ * @param shard Shard to reduce.
+ * @param limit Maximal amount of memory that may remain in use.
+ * @pre The lock of the shard is held by the caller.
+ */
+void SpriteCache::ReduceMemory(SpriteCacheShard *shard, size_t limit)
+{
+	while (shard->stats.memory_used > limit) {
+		assert(!shard->usage.empty());
+		shard->stats.memory_used -= shard->usage.back().second->GetMemorySize();
+		shard->stats.entries--;
+		shard->stats.evictions++;
+		shard->index.erase(shard->usage.back().first);
+		shard->usage.pop_back(); // Threads still using the sprite keep their reference.
+	}
+}
+
+/**
+ * Set the maximal amount of memory used by the decoded sprites.
+ * @param limit Memory limit in bytes, \c 0 disables the cache.
+ */
+void SpriteCache::SetMemoryLimit(size_t limit)
+{
+	this->memory_limit = limit;
+	for (SpriteCacheShard &shard : this->shards) {
+		std::lock_guard<std::mutex> guard(shard.lock);
+		ReduceMemory(&shard, limit / SPRITE_CACHE_SHARDS);
+	}
+}
+
+/** Drop all decoded sprites, for example when the sprites themselves are deleted. */
+void SpriteCache::Clear()
+{
+	for (SpriteCacheShard &shard : this->shards) {
+		std::lock_guard<std::mutex> guard(shard.lock);
+		shard.index.clear();
+		shard.usage.clear();
+		shard.stats.entries = 0;
+		shard.stats.memory_used = 0;
+	}
+}
+
+/**
+ * Get the statistics of the cache.
+ * @param stats [out] Current statistics of all shards together.
+ */
+void SpriteCache::GetStatistics(SpriteCacheStatistics *stats)
+{
+	*stats = {0, 0, 0, 0, 0};
+	for (SpriteCacheShard &shard : this->shards) {
+		std::lock_guard<std::mutex> guard(shard.lock);
+		stats->hits += shard.stats.hits;
+		stats->misses += shard.stats.misses;
+		stats->evictions += shard.stats.evictions;
+		stats->entries += shard.stats.entries;
+		stats->memory_used += shard.stats.memory_used;
+	}
+}
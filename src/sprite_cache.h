@@ -0,0 +1,104 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file sprite_cache.h Cache of decoded sprites. */
+
+#ifndef SPRITE_CACHE_H
+#define SPRITE_CACHE_H
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "palette.h"
+
+class ImageData;
+
+/** Horizontal run of pixels in a #DecodedSprite. */
+struct DecodedSpan {
+	uint16 xpos;   ///< Horizontal position of the first pixel in the sprite.
+	uint16 length; ///< Number of pixels in the run.
+	uint32 first;  ///< Index of the first pixel in DecodedSprite::pixels.
+};
+
+/** 8bpp sprite converted to 32bpp pixels, with recolouring and gradient shift applied. */
+class DecodedSprite {
+public:
+	DecodedSprite(const ImageData *spr, const uint8 *recoloured);
+
+	size_t GetMemorySize() const;
+
+	uint16 width;                   ///< Width of the sprite.
+	uint16 height;                  ///< Height of the sprite.
+	std::vector<uint32> rows;       ///< Index of the first span of each row, followed by the number of spans.
+	std::vector<DecodedSpan> spans; ///< Runs of pixels, ordered by row and horizontal position.
+	std::vector<uint32> pixels;     ///< Pixels of the runs.
+};
+
+/** Key of a decoded sprite in the #SpriteCache. */
+struct SpriteCacheKey {
+	SpriteCacheKey(const ImageData *spr, const Recolouring &recolour, GradientShift shift);
+
+	bool operator<(const SpriteCacheKey &other) const;
+	uint GetHash() const;
+
+	const ImageData *sprite; ///< Sprite being decoded.
+	uint64 recolour;         ///< Source and destination colour ranges of the recolour entries.
+	GradientShift shift;     ///< Gradient shift of the decoded sprite.
+};
+
+/** Statistics of the sprite cache. */
+struct SpriteCacheStatistics {
+	uint64 hits;        ///< Number of sprites found in the cache.
+	uint64 misses;      ///< Number of sprites that had to be decoded.
+	uint64 evictions;   ///< Number of decoded sprites dropped from the cache due to the memory limit.
+	size_t entries;     ///< Number of decoded sprites in the cache.
+	size_t memory_used; ///< Memory used by the decoded sprites in bytes.
+};
+
+/** Decoded sprites with their key, in order of use. */
+typedef std::list<std::pair<SpriteCacheKey, std::shared_ptr<const DecodedSprite>>> SpriteUsageList;
+
+/** Part of the #SpriteCache with its own lock, for the decoded sprites with keys of the same hash. */
+struct SpriteCacheShard {
+	SpriteUsageList usage;                                     ///< Decoded sprites, most recently used first.
+	std::map<SpriteCacheKey, SpriteUsageList::iterator> index; ///< Decoded sprites by key.
+	SpriteCacheStatistics stats;                               ///< Statistics of the shard.
+	std::mutex lock;                                           ///< Lock protecting the shard.
+};
+
+static const uint SPRITE_CACHE_SHARDS = 16; ///< Number of parts of the #SpriteCache, to reduce waiting for its locks.
+
+/**
+ * Bounded cache of 8bpp sprites that have been decoded to 32bpp pixels, to skip the decoding and palette look-ups
+ * of sprites drawn often. When the cache uses more memory than allowed, the least recently used sprites are dropped.
+ * The cache can be used from several threads at the same time. The sprites are spread over #SPRITE_CACHE_SHARDS
+ * independently locked shards that each get an equal part of the memory, and sprites are decoded without holding a lock.
+ */
+class SpriteCache {
+public:
+	SpriteCache();
+
+	std::shared_ptr<const DecodedSprite> Get(const ImageData *spr, const Recolouring &recolour, GradientShift shift);
+	void SetMemoryLimit(size_t limit);
+	void Clear();
+	void GetStatistics(SpriteCacheStatistics *stats);
+
+private:
+	static void ReduceMemory(SpriteCacheShard *shard, size_t limit);
+
+	SpriteCacheShard shards[SPRITE_CACHE_SHARDS]; ///< Parts of the cache.
+	std::atomic<size_t> memory_limit;             ///< Maximal memory used by the decoded sprites of all shards, \c 0 disables the cache.
+};
+
+extern SpriteCache _sprite_cache;
+
+#endif
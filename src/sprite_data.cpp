@@ -12,37 +12,91 @@
 #include "stdafx.h"
 #include "palette.h"
 #include "sprite_data.h"
+#include "sprite_cache.h"
 #include "fileio.h"
 #include "bitmath.h"
+#include "math_func.h"
 
-#include <vector>
+#include <new>
 
-static const int MAX_IMAGE_COUNT = 5000; ///< Maximum number of images that can be loaded (arbitrary number).
+static const size_t MIN_ARENA_CHUNK_SIZE = 64 * 1024; ///< Minimal size of a chunk of an image arena, in bytes.
 
-static std::vector<ImageData> _sprites;  ///< Available sprites to the program.
+std::vector<ImageArena *> _image_arenas; ///< Memory of the images available to the program, one arena for each RCD file with images.
 
 ImageData::ImageData()
 {
+	this->flags = 0;
 	this->width = 0;
 	this->height = 0;
 	this->table = nullptr;
 	this->data = nullptr;
+	this->halved = nullptr;
 }
 
-ImageData::~ImageData()
+/**
+ * Constructor of an image arena.
+ * @param name Name of the arena.
+ * @param chunk_size Expected amount of memory of the arena. Memory is not allocated until it is needed.
+ */
+ImageArena::ImageArena(const char *name, size_t chunk_size) : name(name)
+{
+	this->used = 0;
+	this->reserved = 0;
+	this->chunk_size = std::max(chunk_size, MIN_ARENA_CHUNK_SIZE);
+	this->free_pos = nullptr;
+	this->free_size = 0;
+}
+
+ImageArena::~ImageArena()
+{
+	for (uint8 *chunk : this->chunks) delete[] chunk;
+}
+
+/**
+ * Allocate memory from the arena.
+ * @param size Number of bytes to allocate.
+ * @param align Required alignment of the memory, must be a power of two.
+ * @return The allocated memory.
+ */
+void *ImageArena::Allocate(size_t size, size_t align)
+{
+	size_t padding = (align - reinterpret_cast<uintptr_t>(this->free_pos) % align) % align;
+	if (this->free_pos == nullptr || padding + size > this->free_size) {
+		/* Start a new chunk, the free memory at the end of the previous chunk is not used. */
+		size_t chunk_size = std::max(this->chunk_size, size);
+		this->free_pos = new uint8[chunk_size]; // Memory returned by new is suitably aligned for any type.
+		this->free_size = chunk_size;
+		this->chunks.push_back(this->free_pos);
+		this->reserved += chunk_size;
+		padding = 0;
+	}
+
+	uint8 *mem = this->free_pos + padding;
+	this->free_pos += padding + size;
+	this->free_size -= padding + size;
+	this->used += size;
+	return mem;
+}
+
+/**
+ * Allocate a new image in the arena.
+ * @return The new empty image.
+ * @note The image is not added to #images.
+ */
+ImageData *ImageArena::NewImage()
 {
-	delete[] this->table;
-	delete[] this->data;
+	return new (this->Allocate(sizeof(ImageData), alignof(ImageData))) ImageData;
 }
 
 /**
  * Load image data from the RCD file.
  * @param rcd_file File to load from.
  * @param length Length of the image data block.
+ * @param arena Arena for the memory of the image.
  * @return Load was successful.
  * @pre File pointer is at first byte of the block.
  */
-bool ImageData::Load8bpp(RcdFileReader *rcd_file, size_t length)
+bool ImageData::Load8bpp(RcdFileReader *rcd_file, size_t length, ImageArena *arena)
 {
 	if (length < 8) return false; // 2 bytes width, 2 bytes height, 2 bytes x-offset, and 2 bytes y-offset
 	this->width  = rcd_file->GetUInt16();
@@ -60,9 +114,9 @@ bool ImageData::Load8bpp(RcdFileReader *rcd_file, size_t length)
 	if (length <= jmp_table) return false; // You need at least place for the jump table.
 	length -= jmp_table;
 
-	this->table = new uint32[jmp_table / 4];
-	this->data  = new uint8[length];
-	if (this->table == nullptr || this->data == nullptr) return false;
+	/* The image data follows the jump table in memory. */
+	this->table = static_cast<uint32 *>(arena->Allocate(jmp_table + length, alignof(uint32)));
+	this->data  = reinterpret_cast<uint8 *>(this->table + this->height);
 
 	/* Load jump table, adjusting the entries while loading. */
 	for (uint i = 0; i < this->height; i++) {
@@ -77,6 +131,7 @@ bool ImageData::Load8bpp(RcdFileReader *rcd_file, size_t length)
 	}
 
 	rcd_file->GetBlob(this->data, length); // Load the image data.
+	this->flags = 1 << IFG_IS_8BPP;
 
 	/* Verify the image data. */
 	for (uint i = 0; i < this->height; i++) {
@@ -94,8 +149,11 @@ bool ImageData::Load8bpp(RcdFileReader *rcd_file, size_t length)
 				if (xpos >= this->width || offset >= length) return false;
 			} else {
 				if (xpos > this->width || offset > length) return false;
-				break;
 			}
+			for (const uint8 *pixel = &this->data[offset - count]; pixel < &this->data[offset]; pixel++) {
+				if (*pixel >= COL_SERIES_START && *pixel < COL_SERIES_END) this->flags |= 1 << IFG_RECOLOUR;
+			}
+			if ((rel_pos & 128) != 0) break;
 		}
 	}
 	return true;
@@ -105,9 +163,10 @@ bool ImageData::Load8bpp(RcdFileReader *rcd_file, size_t length)
  * Load a 32bpp image.
  * @param rcd_file Input stream to read from.
  * @param length Length of the 32bpp block.
+ * @param arena Arena for the memory of the image.
  * @return Exeit code, \0 means ok, every other number indicates an error.
  */
-bool ImageData::Load32bpp(RcdFileReader *rcd_file, size_t length)
+bool ImageData::Load32bpp(RcdFileReader *rcd_file, size_t length, ImageArena *arena)
 {
 	if (length < 8) return false; // 2 bytes width, 2 bytes height, 2 bytes x-offset, and 2 bytes y-offset
 	this->width  = rcd_file->GetUInt16();
@@ -122,9 +181,9 @@ bool ImageData::Load32bpp(RcdFileReader *rcd_file, size_t length)
 	if (length > 100 * 1024) return false; // Another arbitrary limit.
 
 	/* Allocate and load the image data. */
-	this->data = new uint8[length];
-	if (this->data == nullptr) return false;
+	this->data = static_cast<uint8 *>(arena->Allocate(length, 1));
 	rcd_file->GetBlob(this->data, length);
+	this->flags = 0;
 
 	/* Verify the data. */
 	uint8 *abs_end = this->data + length;
@@ -160,7 +219,10 @@ bool ImageData::Load32bpp(RcdFileReader *rcd_file, size_t length)
 				case 0: ptr += 3 * (mode & 0x3F); break;
 				case 1: ptr += 1 + 3 * (mode & 0x3F); break;
 				case 2: break;
-				case 3: ptr += 1 + 1 + (mode & 0x3F); break;
+				case 3:
+					ptr += 1 + 1 + (mode & 0x3F);
+					this->flags |= 1 << IFG_RECOLOUR;
+					break;
 			}
 		}
 		if (xpos > this->width) return false;
@@ -257,35 +319,380 @@ uint32 ImageData::GetPixel(uint16 xoffset, uint16 yoffset, const Recolouring *re
 	}
 }
 
+/** Kind of a pixel of a 32bpp image while halving its size. */
+enum HalvePixelKind {
+	HPK_TRANSPARENT, ///< Fully transparent pixel.
+	HPK_RGB,         ///< Pixel with a fixed colour.
+	HPK_RECOLOUR,    ///< Pixel with a colour from a recolour layer.
+};
+
+/** Pixel of a 32bpp image while halving its size. */
+struct HalvePixel {
+	uint8 kind;    ///< Kind of pixel. @see HalvePixelKind
+	uint8 opacity; ///< Opacity of the pixel.
+	uint8 col[3];  ///< Red, green, and blue of a #HPK_RGB pixel; layer (plus one) and index of a #HPK_RECOLOUR pixel.
+};
+
+/**
+ * Decide whether two pixels of a 32bpp image can be in the same run of the image data.
+ * @param a First pixel.
+ * @param b Second pixel.
+ * @return Whether both pixels can be in a single run.
+ */
+static inline bool IsSameRun(const HalvePixel &a, const HalvePixel &b)
+{
+	if (a.kind != b.kind) return false;
+	switch (a.kind) {
+		case HPK_TRANSPARENT: return true;
+		case HPK_RGB:         return a.opacity == b.opacity;
+		case HPK_RECOLOUR:    return a.opacity == b.opacity && a.col[0] == b.col[0];
+		default: NOT_REACHED();
+	}
+}
+
+/**
+ * Compute the pixel of the halved 32bpp image from the pixels it covers in the original image.
+ * A pixel is drawn if at least half of the covered pixels are drawn, so adjacent sprites like ground tiles stay without gaps.
+ * The colour is the opacity weighted average of the covered pixels. If the recoloured pixels are not outnumbered,
+ * the most common recolour layer and index is used instead, so the pixel keeps following the recolouring.
+ * @param samples Non-transparent pixels covered by the new pixel.
+ * @param count Number of pixels in \a samples.
+ * @return The pixel of the halved image.
+ */
+static HalvePixel HalvePixels32bpp(const HalvePixel *samples, int count)
+{
+	HalvePixel result = {HPK_TRANSPARENT, TRANSPARENT, {0, 0, 0}};
+	if (count < 2) return result;
+
+	int num_recolour = 0;
+	for (int i = 0; i < count; i++) {
+		if (samples[i].kind == HPK_RECOLOUR) num_recolour++;
+	}
+
+	uint32 opacity = 0;
+	if (num_recolour * 2 >= count) {
+		int best_votes = 0;
+		for (int i = 0; i < count; i++) {
+			if (samples[i].kind != HPK_RECOLOUR) continue;
+			opacity += samples[i].opacity;
+
+			int votes = 0;
+			for (int j = i; j < count; j++) {
+				if (samples[j].kind == HPK_RECOLOUR && samples[j].col[0] == samples[i].col[0] && samples[j].col[1] == samples[i].col[1]) votes++;
+			}
+			if (votes > best_votes) {
+				best_votes = votes;
+				result.col[0] = samples[i].col[0];
+				result.col[1] = samples[i].col[1];
+			}
+		}
+		result.kind = HPK_RECOLOUR;
+		result.opacity = opacity / num_recolour;
+		return result;
+	}
+
+	uint32 colour[3] = {0, 0, 0};
+	for (int i = 0; i < count; i++) {
+		if (samples[i].kind != HPK_RGB) continue;
+		opacity += samples[i].opacity;
+		for (int c = 0; c < 3; c++) colour[c] += samples[i].col[c] * samples[i].opacity;
+	}
+	result.kind = HPK_RGB;
+	result.opacity = opacity / (count - num_recolour);
+	for (int c = 0; c < 3; c++) result.col[c] = colour[c] / opacity;
+	return result;
+}
+
+/**
+ * Compute the pixel of the halved 8bpp image from the pixels it covers in the original image.
+ * A pixel is drawn if at least half of the covered pixels are drawn. It gets the most common colour index of
+ * the covered pixels, which keeps recolouring, gradient shifts, and the colours of the cursor test sprites working.
+ * @param samples Non-transparent pixels covered by the new pixel.
+ * @param count Number of pixels in \a samples.
+ * @return The colour index of the pixel in the halved image, \c 0 means transparent.
+ */
+static uint8 HalvePixels8bpp(const uint8 *samples, int count)
+{
+	if (count < 2) return 0;
+
+	uint8 best = 0;
+	int best_votes = 0;
+	for (int i = 0; i < count; i++) {
+		int votes = 0;
+		for (int j = i; j < count; j++) {
+			if (samples[j] == samples[i]) votes++;
+		}
+		if (votes > best_votes) {
+			best_votes = votes;
+			best = samples[i];
+		}
+	}
+	return best;
+}
+
+/**
+ * Make this image a copy of another image at half the size.
+ * The pixel grid of the halved image is aligned at the origin of the sprite (rather than at its top-left corner),
+ * so sprites drawn next to each other at half of their normal distance still fit together.
+ * @param src Image to halve.
+ * @param arena Arena for the memory of the image.
+ */
+void ImageData::MakeHalved(const ImageData *src, ImageArena *arena)
+{
+	int16 xoffset = FloorDiv(src->xoffset, 2);
+	int16 yoffset = FloorDiv(src->yoffset, 2);
+	this->xoffset = xoffset;
+	this->yoffset = yoffset;
+	this->width  = FloorDiv(src->xoffset + src->width - 1, 2) - xoffset + 1;
+	this->height = FloorDiv(src->yoffset + src->height - 1, 2) - yoffset + 1;
+	this->flags = src->flags & (1 << IFG_IS_8BPP);
+
+	/* Horizontal and vertical position in the source image of the top-left pixel covered by the first new pixel. */
+	int sx = 2 * xoffset - src->xoffset;
+	int sy = 2 * yoffset - src->yoffset;
+
+	std::vector<uint32> table;
+	std::vector<uint8> data;
+	if (GB(src->flags, IFG_IS_8BPP, 1) != 0) {
+		/* Decode the source image. */
+		std::vector<uint8> pixels(src->width * src->height, 0);
+		for (uint y = 0; y < src->height; y++) {
+			uint32 offset = src->table[y];
+			if (offset == INVALID_JUMP) continue;
+
+			uint xpos = 0;
+			for (;;) {
+				uint8 rel_pos = src->data[offset];
+				uint8 count = src->data[offset + 1];
+				xpos += rel_pos & 127;
+				memcpy(&pixels[y * src->width + xpos], &src->data[offset + 2], count);
+				xpos += count;
+				offset += 2 + count;
+				if ((rel_pos & 128) != 0) break;
+			}
+		}
+
+		/* Encode the new image, row by row. */
+		table.resize(this->height);
+		std::vector<uint8> row(this->width);
+		for (uint y = 0; y < this->height; y++) {
+			for (uint x = 0; x < this->width; x++) {
+				uint8 samples[4];
+				int count = 0;
+				for (int i = 0; i < 4; i++) {
+					int px = sx + 2 * x + (i & 1);
+					int py = sy + 2 * y + (i >> 1);
+					if (px < 0 || px >= src->width || py < 0 || py >= src->height) continue;
+					uint8 pixel = pixels[py * src->width + px];
+					if (pixel != 0) samples[count++] = pixel;
+				}
+				row[x] = HalvePixels8bpp(samples, count);
+				if (row[x] >= COL_SERIES_START && row[x] < COL_SERIES_END) this->flags |= 1 << IFG_RECOLOUR;
+			}
+
+			table[y] = INVALID_JUMP;
+			uint last_end = 0;     // End of the previous run.
+			size_t last_run = 0;   // Offset of the last run in the data.
+			uint x = 0;
+			while (x < this->width) {
+				if (row[x] == 0) {
+					x++;
+					continue;
+				}
+				uint start = x;
+				while (x < this->width && row[x] != 0 && x - start < 255) x++;
+
+				if (table[y] == INVALID_JUMP) table[y] = data.size();
+				uint gap = start - last_end;
+				while (gap > 127) { // Gaps longer than the relative position of a run are bridged with empty runs.
+					data.push_back(127);
+					data.push_back(0);
+					gap -= 127;
+				}
+				last_run = data.size();
+				data.push_back(gap);
+				data.push_back(x - start);
+				data.insert(data.end(), row.begin() + start, row.begin() + x);
+				last_end = x;
+			}
+			if (table[y] != INVALID_JUMP) data[last_run] |= 128;
+		}
+	} else {
+		/* Decode the source image. */
+		std::vector<HalvePixel> pixels(src->width * src->height, {HPK_TRANSPARENT, TRANSPARENT, {0, 0, 0}});
+		const uint8 *ptr = src->data;
+		for (uint y = 0; y < src->height; y++) {
+			ptr += 2; // Length of the line.
+			HalvePixel *line = &pixels[y * src->width];
+			for (;;) {
+				uint8 mode = *ptr++;
+				if (mode == 0) break;
+				uint8 count = mode & 0x3F;
+				switch (mode >> 6) {
+					case 0:
+					case 1: {
+						uint8 opacity = ((mode >> 6) == 0) ? OPAQUE : *ptr++;
+						for (; count > 0; count--) {
+							if (opacity != TRANSPARENT) *line = {HPK_RGB, opacity, {ptr[0], ptr[1], ptr[2]}};
+							line++;
+							ptr += 3;
+						}
+						break;
+					}
+					case 2:
+						line += count;
+						break;
+					case 3: {
+						uint8 layer = ptr[0];
+						uint8 opacity = ptr[1];
+						ptr += 2;
+						for (; count > 0; count--) {
+							if (opacity != TRANSPARENT) *line = {HPK_RECOLOUR, opacity, {layer, *ptr, 0}};
+							line++;
+							ptr++;
+						}
+						break;
+					}
+				}
+			}
+		}
+
+		/* Encode the new image, row by row. */
+		std::vector<HalvePixel> row(this->width);
+		for (uint y = 0; y < this->height; y++) {
+			uint end = 0; // End of the drawn pixels in the row.
+			for (uint x = 0; x < this->width; x++) {
+				HalvePixel samples[4];
+				int count = 0;
+				for (int i = 0; i < 4; i++) {
+					int px = sx + 2 * x + (i & 1);
+					int py = sy + 2 * y + (i >> 1);
+					if (px < 0 || px >= src->width || py < 0 || py >= src->height) continue;
+					const HalvePixel &pixel = pixels[py * src->width + px];
+					if (pixel.kind != HPK_TRANSPARENT) samples[count++] = pixel;
+				}
+				row[x] = HalvePixels32bpp(samples, count);
+				if (row[x].kind != HPK_TRANSPARENT) end = x + 1;
+			}
+
+			size_t line_start = data.size();
+			data.push_back(0); // Length of the line, filled in below.
+			data.push_back(0);
+			uint x = 0;
+			while (x < end) {
+				const HalvePixel &first = row[x];
+				uint count = 1;
+				while (x + count < end && count < 0x3F && IsSameRun(first, row[x + count])) count++;
+
+				switch (first.kind) {
+					case HPK_TRANSPARENT:
+						data.push_back((2 << 6) | count);
+						break;
+
+					case HPK_RGB:
+						if (first.opacity == OPAQUE) {
+							data.push_back(count);
+						} else {
+							data.push_back((1 << 6) | count);
+							data.push_back(first.opacity);
+						}
+						for (uint i = x; i < x + count; i++) data.insert(data.end(), row[i].col, row[i].col + 3);
+						break;
+
+					case HPK_RECOLOUR:
+						data.push_back((3 << 6) | count);
+						data.push_back(first.col[0]);
+						data.push_back(first.opacity);
+						for (uint i = x; i < x + count; i++) data.push_back(row[i].col[1]);
+						this->flags |= 1 << IFG_RECOLOUR;
+						break;
+				}
+				x += count;
+			}
+			data.push_back(0); // End of the line.
+
+			if (y + 1 < this->height) { // The last line has length 0.
+				size_t length = data.size() - line_start;
+				data[line_start] = length & 0xFF;
+				data[line_start + 1] = length >> 8;
+			}
+		}
+	}
+
+	/* Like loaded images, the image data follows the jump table in memory. */
+	size_t table_size = table.size() * sizeof(uint32);
+	uint8 *mem = static_cast<uint8 *>(arena->Allocate(table_size + data.size(), alignof(uint32)));
+	if (!table.empty()) {
+		this->table = reinterpret_cast<uint32 *>(mem);
+		memcpy(this->table, table.data(), table_size);
+	}
+	this->data = mem + table_size;
+	if (!data.empty()) memcpy(this->data, data.data(), data.size());
+}
+
+/**
+ * Create an arena for the images of a RCD file.
+ * @param name Name of the RCD file.
+ * @param chunk_size Expected amount of memory of the images.
+ * @return The new arena, owned by #_image_arenas.
+ */
+ImageArena *CreateImageArena(const char *name, size_t chunk_size)
+{
+	ImageArena *arena = new ImageArena(name, chunk_size);
+	_image_arenas.push_back(arena);
+	return arena;
+}
+
 /**
  * Load 8bpp or 32bpp sprite block from the \a rcd_file.
  * @param rcd_file File being loaded.
+ * @param arena Arena for the memory of the image.
  * @return Loaded sprite, if loading was successful, else \c nullptr.
+ * @note Memory of a failed load is not reused, but loading of the RCD file is aborted anyway.
  */
-ImageData *LoadImage(RcdFileReader *rcd_file)
+ImageData *LoadImage(RcdFileReader *rcd_file, ImageArena *arena)
 {
 	bool is_8bpp = strcmp(rcd_file->name, "8PXL") == 0;
 	if (rcd_file->version != (is_8bpp ? 2 : 1)) return nullptr;
 
-	_sprites.emplace_back();
-	ImageData *imd = &_sprites.back();
-	bool loaded = is_8bpp ? imd->Load8bpp(rcd_file, rcd_file->size) : imd->Load32bpp(rcd_file, rcd_file->size);
-	if (!loaded) {
-		_sprites.pop_back();
-		return nullptr;
-	}
-	imd->flags = is_8bpp ? (1 << IFG_IS_8BPP) : 0;
+	ImageData *imd = arena->NewImage();
+	bool loaded = is_8bpp ? imd->Load8bpp(rcd_file, rcd_file->size, arena) : imd->Load32bpp(rcd_file, rcd_file->size, arena);
+	if (!loaded) return nullptr;
+
+	arena->images.push_back(imd);
 	return imd;
 }
 
-/** Initialize image storage. */
-void InitImageStorage()
+/**
+ * Create the halved versions of all loaded images, for drawing the zoomed-out views of the world.
+ * Images are halved #IMAGE_HALVE_COUNT times, each time from the previous halved image.
+ * The halved images get an arena of their own.
+ */
+void CreateHalvedImages()
 {
-	_sprites.reserve(MAX_IMAGE_COUNT);
+	size_t loaded_count = _image_arenas.size();
+	size_t loaded_size = 0;
+	for (const ImageArena *arena : _image_arenas) loaded_size += arena->used;
+	ImageArena *halved_arena = CreateImageArena("(halved images)", loaded_size / 3); // A quarter plus a sixteenth of the size.
+
+	for (size_t a = 0; a < loaded_count; a++) {
+		for (ImageData *img : _image_arenas[a]->images) {
+			for (int i = 0; i < IMAGE_HALVE_COUNT; i++) {
+				if (img->halved == nullptr) {
+					img->halved = halved_arena->NewImage();
+					img->halved->MakeHalved(img, halved_arena);
+					halved_arena->images.push_back(img->halved);
+				}
+				img = img->halved;
+			}
+		}
+	}
 }
 
 /** Clear all memory. */
 void DestroyImageStorage()
 {
-	_sprites.clear();
+	_sprite_cache.Clear();
+	for (ImageArena *arena : _image_arenas) delete arena;
+	_image_arenas.clear();
 }
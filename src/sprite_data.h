@@ -12,13 +12,19 @@
 #ifndef SPRITE_DATA_H
 #define SPRITE_DATA_H
 
+#include <string>
+#include <vector>
+
 static const uint32 INVALID_JUMP = UINT32_MAX; ///< Invalid jump destination in image data.
+static const int IMAGE_HALVE_COUNT = 2; ///< Number of times images are halved in size, for the zoomed-out views of the world.
 
 class RcdFileReader;
+class ImageArena;
 
 /** Flags of an image in #ImageData. */
 enum ImageFlags {
 	IFG_IS_8BPP = 0, ///< Bit number used for the image type.
+	IFG_RECOLOUR = 1, ///< Bit number used for denoting the image has pixels that depend on the recolouring (and the gradient shift for 8bpp images).
 };
 
 /**
@@ -28,10 +34,10 @@ enum ImageFlags {
 class ImageData {
 public:
 	ImageData();
-	~ImageData();
 
-	bool Load8bpp(RcdFileReader *rcd_file, size_t length);
-	bool Load32bpp(RcdFileReader *rcd_file, size_t length);
+	bool Load8bpp(RcdFileReader *rcd_file, size_t length, ImageArena *arena);
+	bool Load32bpp(RcdFileReader *rcd_file, size_t length, ImageArena *arena);
+	void MakeHalved(const ImageData *src, ImageArena *arena);
 
 	uint32 GetPixel(uint16 xoffset, uint16 yoffset, const Recolouring *recolour = nullptr, GradientShift shift = GS_NORMAL) const;
 
@@ -49,13 +55,43 @@ public:
 	uint16 height; ///< Height of the image.
 	int16 xoffset; ///< Horizontal offset of the image.
 	int16 yoffset; ///< Vertical offset of the image.
-	uint32 *table; ///< The jump table. For missing entries, #INVALID_JUMP is used.
-	uint8 *data;   ///< The image data itself.
+	uint32 *table; ///< The jump table. For missing entries, #INVALID_JUMP is used. Memory is owned by the #ImageArena of the image.
+	uint8 *data;   ///< The image data itself. Memory is owned by the #ImageArena of the image.
+	ImageData *halved; ///< The image at half the size, \c nullptr if not available. @see CreateHalvedImages
 };
 
-ImageData *LoadImage(RcdFileReader *rcd_file);
+/**
+ * Memory of a group of images, such as the images of a RCD file.
+ * The image headers, jump tables, and pixel data are allocated from large chunks in the order of loading,
+ * so the images of a block end up next to each other. All memory is released when the arena is deleted.
+ * @ingroup sprites_group
+ */
+class ImageArena {
+public:
+	ImageArena(const char *name, size_t chunk_size);
+	~ImageArena();
+
+	ImageData *NewImage();
+	void *Allocate(size_t size, size_t align);
+
+	const std::string name;          ///< Name of the arena (the RCD file of the images).
+	std::vector<ImageData *> images; ///< Images of the arena, in order of loading.
+	size_t used;                     ///< Number of bytes allocated from the arena.
+	size_t reserved;                 ///< Number of bytes in the chunks of the arena.
+
+private:
+	size_t chunk_size;           ///< Minimal size of a chunk.
+	std::vector<uint8 *> chunks; ///< Chunks of memory of the arena.
+	uint8 *free_pos;             ///< First free byte of the last chunk.
+	size_t free_size;            ///< Number of free bytes in the last chunk.
+};
+
+ImageArena *CreateImageArena(const char *name, size_t chunk_size);
+ImageData *LoadImage(RcdFileReader *rcd_file, ImageArena *arena);
+void CreateHalvedImages();
 
-void InitImageStorage();
 void DestroyImageStorage();
 
+extern std::vector<ImageArena *> _image_arenas;
+
 #endif
@@ -27,6 +27,7 @@
 #include "shop_type.h"
 #include "coaster.h"
 #include "gui_sprites.h"
+#include "string_func.h"
 
 SpriteManager _sprite_manager; ///< Sprite manager.
 GuiSprites _gui_sprites;       ///< GUI sprites.
@@ -85,52 +86,6 @@ TextData::~TextData()
 	delete[] this->text_data;
 }
 
-/**
- * Decode an UTF-8 character.
- * @param data Pointer to the start of the data.
- * @param length Length of the \a data buffer.
- * @param[out] codepoint If decoding was successful, the value of the decoded character.
- * @return Number of bytes read to decode the character, or \c 0 if reading failed.
- */
-static int DecodeUtf8Char(uint8 *data, size_t length, uint32 *codepoint)
-{
-	if (length < 1) return 0;
-	uint32 value = *data;
-	data++;
-	if ((value & 0x80) == 0) {
-		*codepoint = value;
-		return 1;
-	}
-	int size;
-	uint32 min_value;
-	if ((value & 0xE0) == 0xC0) {
-		size = 2;
-		min_value = 0x80;
-		value &= 0x1F;
-	} else if ((value & 0xF0) == 0xE0) {
-		size = 3;
-		min_value = 0x800;
-		value &= 0x0F;
-	} else if ((value & 0xF8) == 0xF0) {
-		size = 4;
-		min_value = 0x10000;
-		value &= 0x07;
-	} else {
-		return 0;
-	}
-
-	if (length < static_cast<size_t>(size)) return 0;
-	for (int n = 1; n < size; n++) {
-		uint8 val = *data;
-		data++;
-		if ((val & 0xC0) != 0x80) return 0;
-		value = (value << 6) | (val & 0x3F);
-	}
-	if (value < min_value || (value >= 0xD800 && value <= 0xDFFF) || value > 0x10FFFF) return 0;
-	*codepoint = value;
-	return size;
-}
-
 /**
  * Check an UTF-8 string.
  * @param rcd_file Input file.
@@ -1285,8 +1240,69 @@ void SpriteStorage::AddFence(Fence *fnc)
 	this->fence[fnc->type] = fnc;
 }
 
+/**
+ * Get the halved versions of sprites.
+ * @param src Sprites to halve, may contain \c nullptr sprites.
+ * @param dest [out] Halved sprites (may be the same array as \a src).
+ * @param count Number of sprites.
+ */
+static void HalveSprites(ImageData *const *src, ImageData **dest, int count)
+{
+	for (int i = 0; i < count; i++) dest[i] = (src[i] == nullptr) ? nullptr : src[i]->halved;
+}
+
+/**
+ * Fill the storage with the halved sprites of another storage, except the fences and animations as they are RCD blocks.
+ * @param src Storage with sprites of twice the size of this storage.
+ * @pre The halved sprites have been created (see #CreateHalvedImages).
+ */
+void SpriteStorage::CopyHalved(const SpriteStorage &src)
+{
+	assert(src.size == 2 * this->size);
+
+	for (uint i = 0; i < GTP_COUNT; i++) HalveSprites(src.surface[i].surface, this->surface[i].surface, NUM_SLOPE_SPRITES);
+	for (uint i = 0; i < FDT_COUNT; i++) HalveSprites(src.foundation[i].sprites, this->foundation[i].sprites, lengthof(src.foundation[i].sprites));
+	HalveSprites(src.platform.flat,       this->platform.flat,       lengthof(src.platform.flat));
+	HalveSprites(src.platform.ramp,       this->platform.ramp,       lengthof(src.platform.ramp));
+	HalveSprites(src.platform.right_ramp, this->platform.right_ramp, lengthof(src.platform.right_ramp));
+	HalveSprites(src.platform.left_ramp,  this->platform.left_ramp,  lengthof(src.platform.left_ramp));
+	HalveSprites(src.support.sprites, this->support.sprites, SSP_COUNT);
+	HalveSprites(src.tile_select.surface, this->tile_select.surface, NUM_SLOPE_SPRITES);
+	for (uint i = 0; i < VOR_NUM_ORIENT; i++) HalveSprites(src.tile_corners.sprites[i], this->tile_corners.sprites[i], NUM_SLOPE_SPRITES);
+	for (uint i = 0; i < PAT_COUNT; i++) {
+		this->path_sprites[i].status = src.path_sprites[i].status;
+		HalveSprites(src.path_sprites[i].sprites, this->path_sprites[i].sprites, PATH_COUNT);
+	}
+	HalveSprites(src.build_arrows.sprites, this->build_arrows.sprites, lengthof(src.build_arrows.sprites));
+
+	PathDecoration &dec = this->path_decoration;
+	dec = src.path_decoration;
+	HalveSprites(dec.litterbin,        dec.litterbin,        lengthof(dec.litterbin));
+	HalveSprites(dec.overflow_bin,     dec.overflow_bin,     lengthof(dec.overflow_bin));
+	HalveSprites(dec.demolished_bin,   dec.demolished_bin,   lengthof(dec.demolished_bin));
+	HalveSprites(dec.lamp_post,        dec.lamp_post,        lengthof(dec.lamp_post));
+	HalveSprites(dec.demolished_lamp,  dec.demolished_lamp,  lengthof(dec.demolished_lamp));
+	HalveSprites(dec.bench,            dec.bench,            lengthof(dec.bench));
+	HalveSprites(dec.demolished_bench, dec.demolished_bench, lengthof(dec.demolished_bench));
+	HalveSprites(dec.flat_litter,      dec.flat_litter,      lengthof(dec.flat_litter));
+	HalveSprites(dec.flat_vomit,       dec.flat_vomit,       lengthof(dec.flat_vomit));
+	for (uint i = 0; i < lengthof(dec.ramp_litter); i++) HalveSprites(dec.ramp_litter[i], dec.ramp_litter[i], lengthof(dec.ramp_litter[i]));
+	for (uint i = 0; i < lengthof(dec.ramp_vomit); i++) HalveSprites(dec.ramp_vomit[i], dec.ramp_vomit[i], lengthof(dec.ramp_vomit[i]));
+}
+
+/**
+ * Get a sprite drawn at tile width 64 (such as the sprites of rides) at the size of the storage.
+ * @param spr Sprite at tile width 64, may be \c nullptr.
+ * @return The sprite at the size of the storage, if available.
+ */
+const ImageData *SpriteStorage::ScaleSprite(const ImageData *spr) const
+{
+	for (uint16 width = 64; width > this->size && spr != nullptr; width /= 2) spr = spr->halved;
+	return spr;
+}
+
 /** Sprite manager constructor. */
-SpriteManager::SpriteManager() : store(64)
+SpriteManager::SpriteManager() : store(64), store32(32), store16(16)
 {
 	_gui_sprites.Clear();
 	this->blocks = nullptr;
@@ -1318,6 +1334,7 @@ const char *SpriteManager::Load(const char *filename)
 	if (!rcd_file.CheckFileHeader("RCDF", 2)) return "Bad header";
 
 	ImageMap sprites; // Sprites loaded from this file.
+	ImageArena *arena = nullptr; // Memory of the sprites of this file, created with the first sprite.
 	TextMap  texts;   // Texts loaded from this file.
 	TrackPiecesMap track_pieces; // Track pieces loaded from this file.
 
@@ -1332,7 +1349,9 @@ const char *SpriteManager::Load(const char *filename)
 		}
 
 		if (strcmp(rcd_file.name, "8PXL") == 0 || strcmp(rcd_file.name, "32PX") == 0) {
-			ImageData *imd = LoadImage(&rcd_file);
+			/* The images need about as much memory as the remainder of the file. */
+			if (arena == nullptr) arena = CreateImageArena(filename, rcd_file.GetRemaining());
+			ImageData *imd = LoadImage(&rcd_file, arena);
 			if (imd == nullptr) {
 				return "Image data loading failed";
 			}
@@ -1529,7 +1548,45 @@ SpriteStorage *SpriteManager::GetSpriteStore(uint16 width)
 	return nullptr;
 }
 
-/** Load all useful RCD files found by #_rcd_collection, into the program. */
+/**
+ * Fill a sprite storage with the halved sprites of another storage.
+ * @param src Storage with sprites of twice the size of \a dest.
+ * @param dest Storage to fill.
+ */
+void SpriteManager::HalveStore(const SpriteStorage &src, SpriteStorage *dest)
+{
+	dest->CopyHalved(src);
+
+	for (uint i = 0; i < FENCE_TYPE_COUNT; i++) {
+		if (src.fence[i] == nullptr) continue;
+
+		Fence *fnc = new Fence;
+		fnc->type = src.fence[i]->type;
+		fnc->width = dest->size;
+		HalveSprites(src.fence[i]->sprites, fnc->sprites, FENCE_COUNT);
+		this->AddBlock(fnc);
+		dest->AddFence(fnc);
+	}
+
+	for (const auto &entry : src.animations) {
+		const AnimationSprites *src_spr = entry.second;
+
+		AnimationSprites *an_spr = new AnimationSprites;
+		an_spr->width = dest->size;
+		an_spr->person_type = src_spr->person_type;
+		an_spr->anim_type = src_spr->anim_type;
+		an_spr->frame_count = src_spr->frame_count;
+		an_spr->sprites = new ImageData *[an_spr->frame_count];
+		HalveSprites(src_spr->sprites, an_spr->sprites, an_spr->frame_count);
+		this->AddBlock(an_spr);
+		dest->AddAnimationSprites(an_spr);
+	}
+}
+
+/**
+ * Load all useful RCD files found by #_rcd_collection, into the program.
+ * Afterwards, the sprite storages of the smaller sizes are created from the loaded sprites.
+ */
 void SpriteManager::LoadRcdFiles()
 {
 	for (auto &entry : _rcd_collection.rcdfiles) {
@@ -1537,6 +1594,10 @@ void SpriteManager::LoadRcdFiles()
 		const char *mesg = this->Load(fname);
 		if (mesg != nullptr) fprintf(stderr, "Error while reading \"%s\": %s\n", fname, mesg);
 	}
+
+	CreateHalvedImages();
+	this->HalveStore(this->store, &this->store32);
+	this->HalveStore(this->store32, &this->store16);
 }
 
 /**
@@ -1553,12 +1614,15 @@ void SpriteManager::AddBlock(RcdBlock *block)
  * Get a sprite store of a given size.
  * @param size Requested size.
  * @return Sprite store with sprites of the requested size, if it exists, else \c nullptr.
- * @todo Add support for other sprite sizes as well.
  */
 const SpriteStorage *SpriteManager::GetSprites(uint16 size) const
 {
-	if (size != 64) return nullptr;
-	return &this->store;
+	switch (size) {
+		case 64: return &this->store;
+		case 32: return &this->store32;
+		case 16: return &this->store16;
+		default: return nullptr;
+	}
 }
 
 /**
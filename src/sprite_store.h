@@ -476,6 +476,8 @@ public:
 	void RemoveAnimations(AnimationType anim_type, PersonType pers_type);
 	void AddAnimationSprites(AnimationSprites *an_spr);
 	void AddFence(Fence *fnc);
+	void CopyHalved(const SpriteStorage &src);
+	const ImageData *ScaleSprite(const ImageData *spr) const;
 
 	/**
 	 * Get a ground sprite.
@@ -629,10 +631,13 @@ public:
 protected:
 	const char *Load(const char *fname);
 	SpriteStorage *GetSpriteStore(uint16 width);
+	void HalveStore(const SpriteStorage &src, SpriteStorage *dest);
 
 	RcdBlock *blocks;         ///< List of loaded RCD data blocks.
 
 	SpriteStorage store;      ///< Sprite storage of size 64.
+	SpriteStorage store32;    ///< Sprite storage of size 32, created from #store.
+	SpriteStorage store16;    ///< Sprite storage of size 16, created from #store32.
 	AnimationsMap animations; ///< Available animations.
 
 private:
@@ -22,4 +22,6 @@ size_t StrBytesLength(const uint8 *txt);
 bool StrEqual(const uint8 *s1, const uint8 *s2);
 bool StrEndsWith(const char *str, const char *end, bool case_sensitive);
 
+int DecodeUtf8Char(const uint8 *data, size_t length, uint32 *codepoint);
+
 #endif
@@ -15,16 +15,24 @@
 #include "palette.h"
 #include "math_func.h"
 #include "bitmath.h"
+#include "blit_kernels.h"
+#include "sprite_cache.h"
+#include "render_stats.h"
 #include "rev.h"
 #include "freerct.h"
 #include "gamecontrol.h"
 #include "window.h"
 #include "viewport.h"
+#include "ride_type.h"
+#include "person.h"
+#include "people.h"
 #include <string>
 
 VideoSystem _video;  ///< Video sub-system.
 static bool _finish; ///< Finish execution of the main loop (and program).
 
+static const uint MAX_DIRTY_AREAS = 16; ///< Maximal number of separate dirty areas of the display.
+
 /** End the program. */
 void QuitProgram()
 {
@@ -86,6 +94,22 @@ ClippedRectangle::ClippedRectangle(const ClippedRectangle &cr, uint16 x, uint16
 	this->address = nullptr; this->pitch = 0;
 }
 
+/**
+ * Construct a clipped rectangle in memory other than the display, for example an off-screen buffer.
+ * @param address Base address of the top-left pixel.
+ * @param pitch Number of pixels of a row in the memory.
+ * @param w Width.
+ * @param h Height.
+ */
+ClippedRectangle::ClippedRectangle(uint32 *address, int32 pitch, uint16 w, uint16 h)
+{
+	this->absx = 0;
+	this->absy = 0;
+	this->width = w;
+	this->height = h;
+	this->address = address; this->pitch = pitch;
+}
+
 /**
  * Copy constructor.
  * @param cr Existing clipped rectangle.
@@ -120,8 +144,8 @@ ClippedRectangle &ClippedRectangle::operator=(const ClippedRectangle &cr)
 void ClippedRectangle::ValidateAddress()
 {
 	if (this->address == nullptr) {
-		this->pitch = _video.GetXSize();
-		this->address = _video.mem + this->absx + this->absy * this->pitch;
+		this->pitch = _video.display_pitch;
+		this->address = _video.display + this->absx + this->absy * this->pitch;
 	}
 }
 
@@ -132,6 +156,16 @@ void ClippedRectangle::ValidateAddress()
 VideoSystem::VideoSystem()
 {
 	this->initialized = false;
+	this->headless = false;
+	this->frame_interval = 1000 / DEFAULT_FRAME_RATE;
+	this->vsync = false;
+	this->streaming = false;
+	this->window = nullptr;
+	this->renderer = nullptr;
+	this->texture = nullptr;
+	this->mem = nullptr;
+	this->display = nullptr;
+	this->display_pitch = 0;
 }
 
 /** Destructor. */
@@ -144,18 +178,27 @@ VideoSystem::~VideoSystem()
  * Initialize the video system, preparing it for use.
  * @param font_name Name of the font file to load.
  * @param font_size Size of the font.
+ * @param headless Only render into memory, without opening a window (for example, for benchmarking).
  * @return Error message if initialization failed, else an empty text.
  */
-std::string VideoSystem::Initialize(const char *font_name, int font_size)
+std::string VideoSystem::Initialize(const char *font_name, int font_size, bool headless)
 {
 	if (this->initialized) return "";
 
-	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+	this->headless = headless;
+	if (SDL_Init(headless ? SDL_INIT_TIMER : SDL_INIT_VIDEO) != 0) {
 		std::string err = "SDL video initialization failed: ";
 		err += SDL_GetError();
 		return err;
 	}
 
+	SelectBlitKernels();
+
+	if (headless) {
+		this->SetResolution({800, 600}); // Allocates this->mem.
+		return this->InitializeFont(font_name, font_size);
+	}
+
 	std::string caption = "FreeRCT ";
 	caption += _freerct_revision;
 	this->window = SDL_CreateWindow(caption.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_RESIZABLE);
@@ -166,7 +209,7 @@ std::string VideoSystem::Initialize(const char *font_name, int font_size)
 		return err;
 	}
 
-	this->renderer = SDL_CreateRenderer(this->window, -1, SDL_RENDERER_ACCELERATED);
+	this->renderer = SDL_CreateRenderer(this->window, -1, SDL_RENDERER_ACCELERATED | (this->vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
 	if (this->renderer == nullptr) {
 		std::string err = "SDL renderer creation failed: ";
 		err += SDL_GetError();
@@ -198,6 +241,17 @@ std::string VideoSystem::Initialize(const char *font_name, int font_size)
 
 	SDL_StartTextInput(); // Enable Unicode character input.
 
+	return this->InitializeFont(font_name, font_size);
+}
+
+/**
+ * Load the font, and finish initialization of the video system.
+ * @param font_name Name of the font file to load.
+ * @param font_size Size of the font.
+ * @return Error message if initialization failed, else an empty text.
+ */
+std::string VideoSystem::InitializeFont(const char *font_name, int font_size)
+{
 	if (TTF_Init() != 0) {
 		SDL_Quit();
 		delete[] this->mem;
@@ -221,8 +275,9 @@ std::string VideoSystem::Initialize(const char *font_name, int font_size)
 	}
 
 	this->font_height = TTF_FontLineSkip(this->font);
+	this->font_cache.SetFont(this->font);
 	this->initialized = true;
-	this->dirty = true; // Ensure it gets painted.
+	this->MarkDisplayDirty(); // Ensure it gets painted.
 	this->missing_sprites = false;
 
 	this->digit_size.x = 0;
@@ -252,13 +307,15 @@ bool VideoSystem::SetResolution(const Point32 &res)
 
 	this->vid_width = res.x;
 	this->vid_height = res.y;
-	SDL_SetWindowSize(this->window, this->vid_width, this->vid_height);
+	if (!this->headless) {
+		SDL_SetWindowSize(this->window, this->vid_width, this->vid_height);
 
-	this->texture = SDL_CreateTexture(this->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, this->vid_width, this->vid_height);
-	if (this->texture == nullptr) {
-		SDL_Quit();
-		fprintf(stderr, "Could not create texture (%s)\n", SDL_GetError());
-		return false;
+		this->texture = SDL_CreateTexture(this->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, this->vid_width, this->vid_height);
+		if (this->texture == nullptr) {
+			SDL_Quit();
+			fprintf(stderr, "Could not create texture (%s)\n", SDL_GetError());
+			return false;
+		}
 	}
 
 	this->mem = new uint32[this->vid_width * this->vid_height];
@@ -269,9 +326,15 @@ bool VideoSystem::SetResolution(const Point32 &res)
 	}
 
 	/* Update internal screen size data structures. */
+	this->display = this->mem;
+	this->display_pitch = this->vid_width;
+	this->moved_area = Rectangle32();
 	this->blit_rect = ClippedRectangle(0, 0, this->vid_width, this->vid_height);
 	Viewport *vp = GetViewport();
-	if (vp != nullptr) vp->SetSize(this->vid_width, this->vid_height);
+	if (vp != nullptr) {
+		vp->SetSize(this->vid_width, this->vid_height);
+		_guests.OnViewChanged();
+	}
 	_window_manager.RepositionAllWindows();
 	this->MarkDisplayDirty();
 	return true;
@@ -294,23 +357,146 @@ void VideoSystem::GetResolutions()
 /** Mark the entire display as being out of date (it needs the be repainted). */
 void VideoSystem::MarkDisplayDirty()
 {
-	this->dirty = true;
+	this->dirty_areas.clear();
+	this->dirty_areas.emplace_back(0, 0, this->vid_width, this->vid_height);
+}
+
+/**
+ * Compute the bounding box of two rectangles.
+ * @param r1 First rectangle.
+ * @param r2 Second rectangle.
+ * @return Smallest rectangle covering both \a r1 and \a r2.
+ */
+static Rectangle32 GetBoundingBox(const Rectangle32 &r1, const Rectangle32 &r2)
+{
+	int32 left   = std::min(r1.base.x, r2.base.x);
+	int32 top    = std::min(r1.base.y, r2.base.y);
+	int32 right  = std::max(r1.base.x + (int32)r1.width,  r2.base.x + (int32)r2.width);
+	int32 bottom = std::max(r1.base.y + (int32)r1.height, r2.base.y + (int32)r2.height);
+	return Rectangle32(left, top, right - left, bottom - top);
 }
 
 /**
  * Mark the stated area of the screen as being out of date.
+ * Areas are kept non-overlapping by merging an overlapping area into the new area. If there are too many areas, the
+ * new area is merged with the area that grows the least.
  * @param rect %Rectangle which is out of date.
- * @todo Keep an administration of the rectangle(s??) to update, and update just that part.
  */
 void VideoSystem::MarkDisplayDirty(const Rectangle32 &rect)
 {
-	this->dirty = true;
+	Rectangle32 area(rect);
+	area.RestrictTo(0, 0, this->vid_width, this->vid_height);
+	if (area.width == 0 || area.height == 0) return;
+
+	/* Merging may cause overlap with areas that were checked already, restart until nothing overlaps. */
+	uint i = 0;
+	while (i < this->dirty_areas.size()) {
+		if (this->dirty_areas[i].Intersects(area)) {
+			area = GetBoundingBox(area, this->dirty_areas[i]);
+			this->dirty_areas[i] = this->dirty_areas.back();
+			this->dirty_areas.pop_back();
+			i = 0;
+		} else {
+			i++;
+		}
+	}
+
+	if (this->dirty_areas.size() < MAX_DIRTY_AREAS) {
+		this->dirty_areas.push_back(area);
+		return;
+	}
+
+	/* Too many areas, merge with the area that causes the least amount of additional repainting. */
+	uint best = 0;
+	uint32 best_cost = UINT32_MAX;
+	for (i = 0; i < this->dirty_areas.size(); i++) {
+		const Rectangle32 &old_area = this->dirty_areas[i];
+		Rectangle32 merged = GetBoundingBox(area, old_area);
+		uint32 cost = merged.width * merged.height - old_area.width * old_area.height - area.width * area.height;
+		if (cost < best_cost) {
+			best = i;
+			best_cost = cost;
+		}
+	}
+	area = GetBoundingBox(area, this->dirty_areas[best]);
+	this->dirty_areas[best] = this->dirty_areas.back();
+	this->dirty_areas.pop_back();
+	this->MarkDisplayDirty(area); // The merged area may overlap with other areas now.
+}
+
+/**
+ * Move the content of an area of the display, for example after the view of a viewport moved.
+ * The parts of the area that do not get content from inside the area are marked dirty, as are the dirty areas after moving.
+ * Windows in the area are moved as well, the caller must mark them dirty.
+ * @param area Area of the display to move.
+ * @param dx Horizontal movement, new pixel (x, y) of the area is old pixel (x + dx, y + dy).
+ * @param dy Vertical movement.
+ * @return Whether the content was moved. If not, the caller must repaint the whole area.
+ */
+bool VideoSystem::ScrollArea(const Rectangle32 &area, int dx, int dy)
+{
+	if (this->streaming) return false; // The content of a locked texture is not kept between repaints.
+
+	Rectangle32 rect(area);
+	rect.RestrictTo(0, 0, this->vid_width, this->vid_height);
+	if (abs(dx) >= (int)rect.width || abs(dy) >= (int)rect.height) return false;
+
+	int copy_width = rect.width - abs(dx);
+	uint32 *dest = this->mem + rect.base.x + std::max(-dx, 0);
+	const uint32 *src = this->mem + rect.base.x + std::max(dx, 0);
+	if (dy > 0) {
+		for (int y = rect.base.y; y < rect.base.y + (int)rect.height - dy; y++) {
+			memmove(dest + y * this->vid_width, src + (y + dy) * this->vid_width, copy_width * sizeof(uint32));
+		}
+	} else {
+		for (int y = rect.base.y + rect.height - 1; y >= rect.base.y - dy; y--) {
+			memmove(dest + y * this->vid_width, src + (y + dy) * this->vid_width, copy_width * sizeof(uint32));
+		}
+	}
+	this->moved_area = (this->moved_area.width == 0) ? rect : GetBoundingBox(this->moved_area, rect);
+
+	/* Out of date pixels moved along, repaint them at their new position too. */
+	std::vector<Rectangle32> old_areas(this->dirty_areas);
+	for (const Rectangle32 &old_area : old_areas) {
+		Rectangle32 moved(old_area.base.x - dx, old_area.base.y - dy, old_area.width, old_area.height);
+		moved.RestrictTo(rect);
+		this->MarkDisplayDirty(moved);
+	}
+
+	if (dx > 0) this->MarkDisplayDirty(Rectangle32(rect.base.x + rect.width - dx, rect.base.y, dx, rect.height));
+	if (dx < 0) this->MarkDisplayDirty(Rectangle32(rect.base.x, rect.base.y, -dx, rect.height));
+	if (dy > 0) this->MarkDisplayDirty(Rectangle32(rect.base.x, rect.base.y + rect.height - dy, rect.width, dy));
+	if (dy < 0) this->MarkDisplayDirty(Rectangle32(rect.base.x, rect.base.y, rect.width, -dy));
+	return true;
 }
 
-/** Mark the display as being up-to-date. */
-void VideoSystem::MarkDisplayClean()
+/**
+ * Start repainting, and get the areas of the display that need to be repainted. The display is considered to be
+ * up-to-date afterwards. Finish the repaint with #FinishRepaint.
+ *
+ * When streaming, blitting is done directly in the locked texture. Its content is undefined after locking, so the
+ * entire display is repainted then.
+ * @param areas [out] Areas to repaint.
+ */
+void VideoSystem::GetRepaintAreas(std::vector<Rectangle32> *areas)
 {
-	this->dirty = false;
+	areas->clear();
+	areas->swap(this->dirty_areas);
+	if (!this->streaming || this->headless) return;
+
+	void *pixels;
+	int pitch;
+	if (SDL_LockTexture(this->texture, nullptr, &pixels, &pitch) == 0) {
+		this->display = static_cast<uint32 *>(pixels);
+		this->display_pitch = pitch / sizeof(uint32);
+		this->blit_rect = ClippedRectangle(0, 0, this->vid_width, this->vid_height);
+	} else {
+		fprintf(stderr, "Could not lock texture (%s), falling back to copying the display\n", SDL_GetError());
+		this->streaming = false; // The display memory is out of date, repaint all of it.
+	}
+
+	areas->clear();
+	areas->emplace_back(0, 0, this->vid_width, this->vid_height);
 }
 
 /**
@@ -359,6 +545,12 @@ static bool HandleKeyInput(WmKeyCode key_code, const uint8 *symbol)
 	} else if (key_code == WMKC_SYMBOL) {
 		if (symbol[0] == '1') {
 			GetViewport()->ToggleUndergroundMode();
+		} else if (symbol[0] == '+' || symbol[0] == '=') {
+			GetViewport()->Zoom(1);
+		} else if (symbol[0] == '-') {
+			GetViewport()->Zoom(-1);
+		} else if (symbol[0] == 'p') {
+			TogglePerformanceGui();
 		} else if (symbol[0] == 'q') {
 			QuitProgram();
 			return true;
@@ -451,62 +643,157 @@ bool VideoSystem::HandleEvent()
 	}
 }
 
-/** Main loop. Loops until told not to. */
+/**
+ * Set how often the display is rendered.
+ * @param frame_rate Maximal number of rendered frames per second, \c 0 means no limit.
+ * @param vsync Wait for the refresh of the monitor when presenting a frame. Only has effect before #Initialize.
+ */
+void VideoSystem::SetFramePacing(int frame_rate, bool vsync)
+{
+	this->frame_interval = (frame_rate > 0) ? 1000 / frame_rate : 0;
+	this->vsync = vsync;
+}
+
+/**
+ * Set whether to blit directly into the texture of the window, instead of blitting into memory and copying the
+ * repainted areas to the texture. Has no effect without a window.
+ * @param streaming Blit directly into the texture.
+ */
+void VideoSystem::SetStreaming(bool streaming)
+{
+	if (this->initialized && this->streaming && !streaming) this->MarkDisplayDirty(); // Display memory is out of date.
+	this->streaming = streaming;
+}
+
+/**
+ * Main loop. Loops until told not to.
+ * The game is simulated in steps of a fixed amount of game time, independent of rendering. Each loop handles the input
+ * events, runs as many simulation steps as needed to keep up with real time, and renders the display if the next frame
+ * is due. If the machine is too slow to keep up, at most #MAX_CATCH_UP_STEPS steps are run between two rendered frames,
+ * and the game slows down instead.
+ */
 void VideoSystem::MainLoop()
 {
-	static const uint32 FRAME_DELAY = 30; // Number of milliseconds between two frames.
+	static const uint32 FRAME_DELAY = 30;       // Number of milliseconds of game time in a simulation step.
+	static const uint MAX_CATCH_UP_STEPS = 5;   // Maximal number of simulation steps between two rendered frames.
 	bool missing_sprites_check = false;
 	_finish = false;
 
+	uint32 previous = SDL_GetTicks();
+	uint32 last_render = previous;
+	uint32 lag = FRAME_DELAY; // Real time that has not been simulated yet, start with a step.
 	while (!_finish) {
-		uint32 start = SDL_GetTicks();
-
-		OnNewFrame(FRAME_DELAY);
-
-		/* Handle input events until time for the next frame has arrived. */
+		/* Handle all pending input events. */
 		for (;;) {
 			if (HandleEvent()) break;
 		}
 		if (_finish) break;
 
 		uint32 now = SDL_GetTicks();
-		if (now >= start) { // No wrap around.
-			now -= start;
-			if (now < FRAME_DELAY) SDL_Delay(FRAME_DELAY - now); // Too early, wait until next frame.
+		lag += now - previous; // Unsigned arithmetic handles wrap around.
+		previous = now;
+
+		uint steps = 0;
+		while (lag >= FRAME_DELAY && steps < MAX_CATCH_UP_STEPS) {
+			OnNewFrame(FRAME_DELAY);
+			lag -= FRAME_DELAY;
+			steps++;
+		}
+		if (lag >= FRAME_DELAY) lag %= FRAME_DELAY; // Too far behind, drop the time that cannot be caught up.
+		FlushDirtyVoxels();
+
+		/* Render at most one frame for each frame interval, frames falling behind are skipped. */
+		if (now - last_render >= this->frame_interval) {
+			if (this->DisplayNeedsRepaint()) this->RenderFrame();
+			last_render = now;
 		}
 
 		if (!missing_sprites_check && this->missing_sprites) {
 			ShowGraphicsErrorMessage();
 			missing_sprites_check = true;
 		}
+
+		/* Sleep until the next simulation step or frame is due, unless rendering as often as possible. */
+		if (this->frame_interval == 0 && this->DisplayNeedsRepaint()) continue;
+		uint32 wait = FRAME_DELAY - lag; // Both waiting times are relative to 'now'.
+		if (this->DisplayNeedsRepaint()) wait = std::min(wait, last_render + this->frame_interval - now);
+		uint32 busy = SDL_GetTicks() - now;
+		if (wait > busy) SDL_Delay(wait - busy);
 	}
 }
 
+/** Repaint the display, and measure the performance of the frame. */
+void VideoSystem::RenderFrame()
+{
+	static const uint PERFORMANCE_REFRESH = 16; // Number of frames between two updates of the performance window.
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	UpdateWindows();
+	std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+	_render_times.repaint += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+	_render_times.guests = _guests.CountActiveGuests();
+
+	_performance.EndFrame();
+	if (_performance.frame_count % PERFORMANCE_REFRESH == 0) NotifyChange(WC_PERFORMANCE, ALL_WINDOWS_OF_TYPE, CHG_DISPLAY_OLD, 0);
+}
+
 /** Close down the video system. */
 void VideoSystem::Shutdown()
 {
 	if (this->initialized) {
+		this->font_cache.SetFont(nullptr);
 		TTF_CloseFont(this->font);
 		TTF_Quit();
 		SDL_Quit();
 		delete[] this->mem;
 		this->initialized = false;
-		this->dirty = false;
+		this->dirty_areas.clear();
 	}
 }
 
 /**
  * Finish repainting, perform the final steps.
- * @todo Implement partial window repainting.
+ * A locked texture is unlocked, else only the repainted areas of the display are uploaded to the GPU.
+ * @param areas Repainted areas of the display.
  */
-void VideoSystem::FinishRepaint()
+void VideoSystem::FinishRepaint(const std::vector<Rectangle32> &areas)
 {
-	SDL_UpdateTexture(this->texture, nullptr, this->mem, this->GetXSize() * sizeof(uint32)); // Upload memory to the GPU.
+	if (this->headless) { // The display only exists in memory.
+		this->moved_area = Rectangle32();
+		return;
+	}
+
+	PhaseTimer timer(RP_PRESENT);
+	if (this->display != this->mem) {
+		SDL_UnlockTexture(this->texture);
+		this->display = this->mem;
+		this->display_pitch = this->vid_width;
+		this->blit_rect = ClippedRectangle(0, 0, this->vid_width, this->vid_height);
+	} else {
+		/* Upload the moved content, and the repainted areas that are not part of it. */
+		if (this->moved_area.width != 0) this->UploadArea(this->moved_area);
+		for (const Rectangle32 &area : areas) {
+			if (!this->moved_area.Contains(area)) this->UploadArea(area);
+		}
+	}
+	this->moved_area = Rectangle32();
 	SDL_RenderClear(this->renderer);
 	SDL_RenderCopy(this->renderer, this->texture, nullptr, nullptr);
 	SDL_RenderPresent(this->renderer);
+}
 
-	MarkDisplayClean();
+/**
+ * Copy an area of the display memory to the texture.
+ * @param area Area of the display to copy.
+ */
+void VideoSystem::UploadArea(Rectangle32 area)
+{
+	area.RestrictTo(0, 0, this->vid_width, this->vid_height);
+	if (area.width == 0 || area.height == 0) return;
+
+	SDL_Rect sdl_rect = {area.base.x, area.base.y, static_cast<int>(area.width), static_cast<int>(area.height)};
+	const uint32 *pixels = this->mem + area.base.x + area.base.y * this->GetXSize();
+	SDL_UpdateTexture(this->texture, &sdl_rect, pixels, this->GetXSize() * sizeof(uint32)); // Upload memory to the GPU.
 }
 
 /**
@@ -546,8 +833,62 @@ static void BlitPixel(const ClippedRectangle &cr, uint32 *scr_base,
 	}
 }
 
+/**
+ * Write a pixel of a sprite.
+ * @tparam TILED Sprite is drawn \a numx times \a numy times, else it is drawn once and the pixel is inside the clipped rectangle.
+ * @param cr Clipped rectangle.
+ * @param scr Address of the pixel in the screen array.
+ * @param xpos X position of the pixel.
+ * @param ypos Y position of the pixel.
+ * @param numx Number of sprites to draw in horizontal direction.
+ * @param numy Number of sprites to draw in vertical direction.
+ * @param spr Sprite being drawn.
+ * @param colour Pixel value to write.
+ */
+template <bool TILED>
+static inline void WritePixel(const ClippedRectangle &cr, uint32 *scr, int32 xpos, int32 ypos, uint16 numx, uint16 numy, const ImageData *spr, uint32 colour)
+{
+	if (TILED) {
+		BlitPixel(cr, scr, xpos, ypos, numx, numy, spr->width, spr->height, colour);
+	} else {
+		*scr = colour;
+	}
+}
+
+/**
+ * Compute the part of a run of pixels that is inside the clipped rectangle.
+ * @param xpos X position of the first pixel of the run.
+ * @param count Number of pixels in the run.
+ * @param width Width of the clipped rectangle.
+ * @param first [out] Index of the first pixel to draw.
+ * @param last [out] Index after the last pixel to draw, never less than \a first.
+ */
+static inline void ClipRun(int32 xpos, int count, int32 width, int *first, int *last)
+{
+	*first = Clamp(-xpos, 0, count);
+	*last = Clamp(width - xpos, *first, count);
+}
+
+/**
+ * Blend a partially opaque pixel with the previously drawn pixel.
+ * @param colour Pixel to draw, after applying the gradient shift.
+ * @param old_pixel Previously drawn pixel.
+ * @param opacity Opacity of \a colour.
+ * @return Opaque pixel with the blended colour.
+ */
+static inline uint32 BlendPixel(uint32 colour, uint32 old_pixel, uint8 opacity)
+{
+	uint r = GetR(colour) * opacity + GetR(old_pixel) * (256 - opacity);
+	uint g = GetG(colour) * opacity + GetG(old_pixel) * (256 - opacity);
+	uint b = GetB(colour) * opacity + GetB(old_pixel) * (256 - opacity);
+	return MakeRGBA(r >> 8, g >> 8, b >> 8, OPAQUE);
+}
+
 /**
  * Blit 8bpp images to the screen.
+ * @tparam TILED Sprite is drawn \a numx times \a numy times (pixels are clipped one at a time), else it is drawn once.
+ * @tparam CLIPPED Single sprite may be partially outside the clipped rectangle, else it is completely inside.
+ * @tparam RECOLOUR Sprite has pixels that need recolouring (#IFG_RECOLOUR), else \a recoloured is not used.
  * @param cr Clipped rectangle to draw to.
  * @param x_base Base X coordinate of the sprite data.
  * @param y_base Base Y coordinate of the sprite data.
@@ -556,41 +897,48 @@ static void BlitPixel(const ClippedRectangle &cr, uint32 *scr_base,
  * @param numy Number of sprites to draw in vertical direction.
  * @param recoloured Shifted palette to use.
  */
+template <bool TILED, bool CLIPPED, bool RECOLOUR>
 static void Blit8bppImages(const ClippedRectangle &cr, int32 x_base, int32 y_base, const ImageData *spr, uint16 numx, uint16 numy, const uint8 *recoloured)
 {
 	uint32 *line_base = cr.address + x_base + cr.pitch * y_base;
 	int32 ypos = y_base;
-	for (int yoff = 0; yoff < spr->height; yoff++) {
+	for (int yoff = 0; yoff < spr->height; yoff++, line_base += cr.pitch, ypos++) {
+		if (!TILED && CLIPPED) {
+			if (ypos < 0) continue;
+			if (ypos >= cr.height) break;
+		}
 		uint32 offset = spr->table[yoff];
-		if (offset != INVALID_JUMP) {
-			int32 xpos = x_base;
-			uint32 *src_base = line_base;
-			for (;;) {
-				uint8 rel_off = spr->data[offset];
-				uint8 count   = spr->data[offset + 1];
-				uint8 *pixels = &spr->data[offset + 2];
-				offset += 2 + count;
-
-				xpos += rel_off & 127;
-				src_base += rel_off & 127;
-				while (count > 0) {
-					uint32 colour = _palette[recoloured[*pixels]];
-					BlitPixel(cr, src_base, xpos, ypos, numx, numy, spr->width, spr->height, colour);
-					pixels++;
-					xpos++;
-					src_base++;
-					count--;
-				}
-				if ((rel_off & 128) != 0) break;
+		if (offset == INVALID_JUMP) continue;
+
+		int32 xpos = x_base;
+		uint32 *src_base = line_base;
+		for (;;) {
+			uint8 rel_off = spr->data[offset];
+			uint8 count   = spr->data[offset + 1];
+			const uint8 *pixels = &spr->data[offset + 2];
+			offset += 2 + count;
+
+			xpos += rel_off & 127;
+			src_base += rel_off & 127;
+			int first = 0;
+			int last = count;
+			if (!TILED && CLIPPED) ClipRun(xpos, count, cr.width, &first, &last);
+			for (int i = first; i < last; i++) {
+				uint32 colour = _palette[RECOLOUR ? recoloured[pixels[i]] : pixels[i]];
+				WritePixel<TILED>(cr, src_base + i, xpos + i, ypos, numx, numy, spr, colour);
 			}
+			xpos += count;
+			src_base += count;
+			if ((rel_off & 128) != 0) break;
 		}
-		line_base += cr.pitch;
-		ypos++;
 	}
 }
 
 /**
  * Blit 32bpp images to the screen.
+ * @tparam TILED Sprite is drawn \a numx times \a numy times (pixels are clipped one at a time), else it is drawn once.
+ * @tparam CLIPPED Single sprite may be partially outside the clipped rectangle, else it is completely inside.
+ * @tparam RECOLOUR Sprite has recoloured pixels (#IFG_RECOLOUR), else \a recolour is not used.
  * @param cr Clipped rectangle to draw to.
  * @param x_base Base X coordinate of the sprite data.
  * @param y_base Base Y coordinate of the sprite data.
@@ -600,83 +948,141 @@ static void Blit8bppImages(const ClippedRectangle &cr, int32 x_base, int32 y_bas
  * @param recolour Sprite recolouring definition.
  * @param shift Gradient shift.
  */
+template <bool TILED, bool CLIPPED, bool RECOLOUR>
 static void Blit32bppImages(const ClippedRectangle &cr, int32 x_base, int32 y_base, const ImageData *spr, uint16 numx, uint16 numy, const Recolouring &recolour, GradientShift shift)
 {
 	uint32 *line_base = cr.address + x_base + cr.pitch * y_base;
 	ShiftFunc sf = GetGradientShiftFunc(shift);
+	int shift_amount = (shift - GS_NORMAL) * STEP_SIZE; // Gradient shift for the kernels.
 	int32 ypos = y_base;
-	const uint8 *src = spr->data + 2; // Skip the length word.
-	for (int yoff = 0; yoff < spr->height; yoff++) {
+	const uint8 *src = spr->data;
+	for (int yoff = 0; yoff < spr->height; yoff++, line_base += cr.pitch, ypos++) {
+		if (!TILED && CLIPPED) {
+			if (ypos >= cr.height) break;
+			if (ypos < 0) { // Use the length word to skip the line.
+				src += src[0] | (src[1] << 8);
+				continue;
+			}
+		}
+		src += 2; // Skip the length word.
+
 		int32 xpos = x_base;
 		uint32 *src_base = line_base;
 		for (;;) {
 			uint8 mode = *src++;
 			if (mode == 0) break;
+
+			int count = mode & 0x3F;
+			int first = 0;
+			int last = count;
+			if (!TILED && CLIPPED) ClipRun(xpos, count, cr.width, &first, &last);
 			switch (mode >> 6) {
 				case 0: // Fully opaque pixels.
-					mode &= 0x3F;
-					for (; mode > 0; mode--) {
-						uint32 colour = MakeRGBA(sf(src[0]), sf(src[1]), sf(src[2]), OPAQUE);
-						BlitPixel(cr, src_base, xpos, ypos, numx, numy, spr->width, spr->height, colour);
-						xpos++;
-						src_base++;
-						src += 3;
+					if (!TILED && _blit_kernels.opaque != nullptr) {
+						if (first < last) _blit_kernels.opaque(src_base + first, src + 3 * first, last - first, shift_amount);
+					} else {
+						for (int i = first; i < last; i++) {
+							const uint8 *pixel = src + 3 * i;
+							uint32 colour = MakeRGBA(sf(pixel[0]), sf(pixel[1]), sf(pixel[2]), OPAQUE);
+							WritePixel<TILED>(cr, src_base + i, xpos + i, ypos, numx, numy, spr, colour);
+						}
 					}
+					src += 3 * count;
 					break;
 
 				case 1: { // Partial opaque pixels.
 					uint8 opacity = *src++;
-					mode &= 0x3F;
-					for (; mode > 0; mode--) {
-						/* Cheat transparency a bit by just recolouring the previously drawn pixel */
-						uint32 old_pixel = *src_base;
-
-						uint r = sf(src[0]) * opacity + GetR(old_pixel) * (256 - opacity);
-						uint g = sf(src[1]) * opacity + GetG(old_pixel) * (256 - opacity);
-						uint b = sf(src[2]) * opacity + GetB(old_pixel) * (256 - opacity);
-
-						/* Opaque, but colour adjusted depending on the old pixel. */
-						uint32 ndest = MakeRGBA(r >> 8, g >> 8, b >> 8, OPAQUE);
-						BlitPixel(cr, src_base, xpos, ypos, numx, numy, spr->width, spr->height, ndest);
-						xpos++;
-						src_base++;
-						src += 3;
+					if (!TILED && _blit_kernels.translucent != nullptr) {
+						if (first < last) _blit_kernels.translucent(src_base + first, src + 3 * first, last - first, opacity, shift_amount);
+					} else {
+						for (int i = first; i < last; i++) {
+							const uint8 *pixel = src + 3 * i;
+							/* Cheat transparency a bit by just recolouring the previously drawn pixel */
+							uint32 colour = MakeRGBA(sf(pixel[0]), sf(pixel[1]), sf(pixel[2]), OPAQUE);
+							WritePixel<TILED>(cr, src_base + i, xpos + i, ypos, numx, numy, spr, BlendPixel(colour, src_base[i], opacity));
+						}
 					}
+					src += 3 * count;
 					break;
 				}
 				case 2: // Fully transparent pixels.
-					xpos += mode & 0x3F;
-					src_base += mode & 0x3F;
 					break;
 
 				case 3: { // Recoloured pixels.
+					assert(RECOLOUR);
 					uint8 layer = *src++;
 					const uint32 *table = recolour.GetRecolourTable(layer - 1);
 					uint8 opacity = *src++;
-					mode &= 0x3F;
-					for (; mode > 0; mode--) {
-						uint32 old_pixel = *src_base;
-						uint32 recoloured = table[*src++];
-
-						uint r = sf(GetR(recoloured)) * opacity + GetR(old_pixel) * (256 - opacity);
-						uint g = sf(GetG(recoloured)) * opacity + GetG(old_pixel) * (256 - opacity);
-						uint b = sf(GetB(recoloured)) * opacity + GetB(old_pixel) * (256 - opacity);
-
-						uint32 colour = MakeRGBA(r >> 8, g >> 8, b >> 8, OPAQUE);
-						BlitPixel(cr, src_base, xpos, ypos, numx, numy, spr->width, spr->height, colour);
-						xpos++;
-						src_base++;
+					if (!TILED && _blit_kernels.recolour != nullptr) {
+						if (first < last) _blit_kernels.recolour(src_base + first, src + first, last - first, table, opacity, shift_amount);
+					} else {
+						for (int i = first; i < last; i++) {
+							uint32 recoloured = table[src[i]];
+							uint32 colour = MakeRGBA(sf(GetR(recoloured)), sf(GetG(recoloured)), sf(GetB(recoloured)), OPAQUE);
+							WritePixel<TILED>(cr, src_base + i, xpos + i, ypos, numx, numy, spr, BlendPixel(colour, src_base[i], opacity));
+						}
 					}
+					src += count;
 					break;
 				}
 			}
+			xpos += count;
+			src_base += count;
 		}
-		line_base += cr.pitch;
-		ypos++;
-		src += 2; // Skip the length word.
 	}
 }
 
+/**
+ * Blit a decoded 8bpp sprite to the screen.
+ * @param cr Clipped rectangle to draw to.
+ * @param x_base Base X coordinate of the sprite data.
+ * @param y_base Base Y coordinate of the sprite data.
+ * @param decoded The decoded sprite to blit.
+ */
+static void BlitDecodedImage(const ClippedRectangle &cr, int32 x_base, int32 y_base, const DecodedSprite &decoded)
+{
+	int first_row = std::max(0, -y_base);
+	int last_row = std::min<int32>(decoded.height, cr.height - y_base);
+	for (int yoff = first_row; yoff < last_row; yoff++) {
+		uint32 *line_base = cr.address + x_base + cr.pitch * (y_base + yoff);
+		for (uint32 s = decoded.rows[yoff]; s < decoded.rows[yoff + 1]; s++) {
+			const DecodedSpan &span = decoded.spans[s];
+			int first, last;
+			ClipRun(x_base + span.xpos, span.length, cr.width, &first, &last);
+			if (first < last) memcpy(line_base + span.xpos + first, &decoded.pixels[span.first + first], (last - first) * sizeof(uint32));
+		}
+	}
+}
+
+/** Ways of drawing a sprite, first index of the blitter tables. */
+enum BlitterKind {
+	BK_INSIDE,  ///< Single sprite, completely inside the clipped rectangle.
+	BK_CLIPPED, ///< Single sprite, partially outside the clipped rectangle.
+	BK_TILED,   ///< Several copies of the sprite (in the gui).
+
+	BK_COUNT,   ///< Number of blitter kinds.
+};
+
+/** Blitter of 8bpp sprites. */
+typedef void (*Blit8bppFunc)(const ClippedRectangle &cr, int32 x_base, int32 y_base, const ImageData *spr, uint16 numx, uint16 numy, const uint8 *recoloured);
+
+/** Blitter of 32bpp sprites. */
+typedef void (*Blit32bppFunc)(const ClippedRectangle &cr, int32 x_base, int32 y_base, const ImageData *spr, uint16 numx, uint16 numy, const Recolouring &recolour, GradientShift shift);
+
+/** 8bpp blitters, by #BlitterKind and whether the sprite needs recolouring. */
+static const Blit8bppFunc _blitters_8bpp[BK_COUNT][2] = {
+	{Blit8bppImages<false, false, false>, Blit8bppImages<false, false, true>},
+	{Blit8bppImages<false, true,  false>, Blit8bppImages<false, true,  true>},
+	{Blit8bppImages<true,  true,  false>, Blit8bppImages<true,  true,  true>},
+};
+
+/** 32bpp blitters, by #BlitterKind and whether the sprite needs recolouring. */
+static const Blit32bppFunc _blitters_32bpp[BK_COUNT][2] = {
+	{Blit32bppImages<false, false, false>, Blit32bppImages<false, false, true>},
+	{Blit32bppImages<false, true,  false>, Blit32bppImages<false, true,  true>},
+	{Blit32bppImages<true,  true,  false>, Blit32bppImages<true,  true,  true>},
+};
+
 /**
  * Blit pixels from the \a spr relative to \a img_base into the area.
  * @param pt Base coordinates of the sprite data.
@@ -689,6 +1095,25 @@ static void Blit32bppImages(const ClippedRectangle &cr, int32 x_base, int32 y_ba
 void VideoSystem::BlitImages(const Point32 &pt, const ImageData *spr, uint16 numx, uint16 numy, const Recolouring &recolour, GradientShift shift)
 {
 	this->blit_rect.ValidateAddress();
+	this->BlitImages(this->blit_rect, pt, spr, numx, numy, recolour, shift);
+}
+
+/**
+ * Blit pixels from the \a spr relative to \a img_base into a given area.
+ * Unlike the other blit functions, the clipped rectangle of the video system is not used, which makes it safe to
+ * blit to different areas from several threads at the same time.
+ * @param cr Clipped rectangle to draw to, its address must be valid.
+ * @param pt Base coordinates of the sprite data.
+ * @param spr The sprite to blit.
+ * @param numx Number of sprites to draw in horizontal direction.
+ * @param numy Number of sprites to draw in vertical direction.
+ * @param recolour Sprite recolouring definition.
+ * @param shift Gradient shift.
+ * @note With 8bpp sprites, the palette of \a recolour must already be computed for \a shift (see Recolouring::GetPalette) when blitting from several threads.
+ */
+void VideoSystem::BlitImages(const ClippedRectangle &cr, const Point32 &pt, const ImageData *spr, uint16 numx, uint16 numy, const Recolouring &recolour, GradientShift shift) const
+{
+	assert(cr.address != nullptr);
 
 	int x_base = pt.x + spr->xoffset;
 	int y_base = pt.y + spr->yoffset;
@@ -697,19 +1122,38 @@ void VideoSystem::BlitImages(const Point32 &pt, const ImageData *spr, uint16 num
 	while (numx > 0 && x_base + spr->width < 0) {
 		x_base += spr->width; numx--;
 	}
-	while (numx > 0 && x_base + (numx - 1) * spr->width >= this->blit_rect.width) numx--;
+	while (numx > 0 && x_base + (numx - 1) * spr->width >= cr.width) numx--;
 	if (numx == 0) return;
 
 	while (numy > 0 && y_base + spr->height < 0) {
 		y_base += spr->height; numy--;
 	}
-	while (numy > 0 && y_base + (numy - 1) * spr->height >= this->blit_rect.height) numy--;
+	while (numy > 0 && y_base + (numy - 1) * spr->height >= cr.height) numy--;
 	if (numy == 0) return;
 
+	/* Select the blitter once for the entire sprite. */
+	BlitterKind kind;
+	if (numx > 1 || numy > 1) {
+		kind = BK_TILED;
+	} else if (x_base < 0 || y_base < 0 || x_base + spr->width > cr.width || y_base + spr->height > cr.height) {
+		kind = BK_CLIPPED;
+	} else {
+		kind = BK_INSIDE;
+	}
+	uint needs_recolour = GB(spr->flags, IFG_RECOLOUR, 1);
+
 	if (GB(spr->flags, IFG_IS_8BPP, 1) != 0) {
-		Blit8bppImages(this->blit_rect, x_base, y_base, spr, numx, numy, recolour.GetPalette(shift));
+		if (kind != BK_TILED) {
+			std::shared_ptr<const DecodedSprite> decoded = _sprite_cache.Get(spr, recolour, shift);
+			if (decoded != nullptr) {
+				BlitDecodedImage(cr, x_base, y_base, *decoded);
+				return;
+			}
+		}
+		const uint8 *recoloured = (needs_recolour != 0) ? recolour.GetPalette(shift) : nullptr;
+		_blitters_8bpp[kind][needs_recolour](cr, x_base, y_base, spr, numx, numy, recoloured);
 	} else {
-		Blit32bppImages(this->blit_rect, x_base, y_base, spr, numx, numy, recolour, shift);
+		_blitters_32bpp[kind][needs_recolour](cr, x_base, y_base, spr, numx, numy, recolour, shift);
 	}
 }
 
@@ -721,10 +1165,9 @@ void VideoSystem::BlitImages(const Point32 &pt, const ImageData *spr, uint16 num
  */
 void VideoSystem::GetTextSize(const uint8 *text, int *width, int *height)
 {
-	if (TTF_SizeUTF8(this->font, (const char *)text, width, height) != 0) {
-		*width = 0;
-		*height = 0;
-	}
+	const TextLayout &layout = this->font_cache.GetLayout(text);
+	*width = layout.width;
+	*height = layout.height;
 }
 
 /**
@@ -776,19 +1219,9 @@ void VideoSystem::GetNumberRangeSize(int64 smallest, int64 biggest, int *width,
  */
 void VideoSystem::BlitText(const uint8 *text, uint32 colour, int xpos, int ypos, int width, Alignment align)
 {
-	SDL_Color col = {0, 0, 0}; // Font colour does not matter as only the bitmap is used.
-	SDL_Surface *surf = TTF_RenderUTF8_Solid(this->font, (const char *)text, col);
-	if (surf == nullptr) {
-		fprintf(stderr, "Rendering text failed (%s)\n", TTF_GetError());
-		return;
-	}
+	const TextLayout &layout = this->font_cache.GetLayout(text);
 
-	if (surf->format->BitsPerPixel != 8 || surf->format->BytesPerPixel != 1) {
-		fprintf(stderr, "Rendering text failed (Wrong surface format)\n");
-		return;
-	}
-
-	int real_w = std::min(surf->w, width);
+	int real_w = std::min(layout.width, width);
 	switch (align) {
 		case ALG_LEFT:
 			break;
@@ -806,43 +1239,32 @@ void VideoSystem::BlitText(const uint8 *text, uint32 colour, int xpos, int ypos,
 
 	this->blit_rect.ValidateAddress();
 
-	uint8 *src = ((uint8 *)surf->pixels);
-	uint32 *dest = this->blit_rect.address + xpos + ypos * this->blit_rect.pitch;
-	int h = surf->h;
-	if (ypos < 0) {
-		h += ypos;
-		src  -= ypos * surf->pitch;
-		dest -= ypos * this->blit_rect.pitch;
-		ypos = 0;
-	}
-	while (h > 0) {
-		if (ypos >= this->blit_rect.height) break;
-		uint8 *src2 = src;
-		uint32 *dest2 = dest;
-		int w = real_w;
-		int x = xpos;
-		if (x < 0) {
-			w += x;
-			if (w <= 0) break;
-			dest2 -= x;
-			src2 -= x;
-			x = 0;
-		}
-		while (w > 0) {
-			if (x >= this->blit_rect.width) break;
-			if (*src2 != 0) *dest2 = colour;
-			src2++;
-			dest2++;
-			x++;
-			w--;
+	/* Area of the display to draw in, the text is clipped to the available width. */
+	int left = std::max(xpos, 0);
+	int right = std::min(xpos + real_w, static_cast<int>(this->blit_rect.width));
+	int top = std::max(ypos, 0);
+	int bottom = std::min(ypos + layout.height, static_cast<int>(this->blit_rect.height));
+	if (left >= right || top >= bottom) return;
+
+	for (const PlacedGlyph &placed : layout.glyphs) {
+		const CachedGlyph &glyph = this->font_cache.GetGlyph(placed.index);
+		int gx = xpos + placed.xpos;
+		int x_first = std::max(left - gx, 0);
+		int x_last = std::min(right - gx, static_cast<int>(glyph.width));
+		int y_first = std::max(top - ypos, 0);
+		int y_last = std::min(bottom - ypos, static_cast<int>(glyph.height));
+		if (x_first >= x_last || y_first >= y_last) continue;
+
+		const uint8 *mask = this->font_cache.GetMask(glyph) + y_first * glyph.width;
+		uint32 *dest = this->blit_rect.address + gx + (ypos + y_first) * this->blit_rect.pitch;
+		for (int y = y_first; y < y_last; y++) {
+			for (int x = x_first; x < x_last; x++) {
+				if (mask[x] != 0) dest[x] = colour;
+			}
+			mask += glyph.width;
+			dest += this->blit_rect.pitch;
 		}
-		ypos++;
-		src  += surf->pitch;
-		dest += this->blit_rect.pitch;
-		h--;
 	}
-
-	SDL_FreeSurface(surf);
 }
 
 /**
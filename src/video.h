@@ -13,13 +13,18 @@
 #define VIDEO_H
 
 #include <set>
+#include <string>
+#include <vector>
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include "geometry.h"
 #include "palette.h"
+#include "font_cache.h"
 
 void QuitProgram();
 
+static const int DEFAULT_FRAME_RATE = 60; ///< Default maximal number of rendered frames per second.
+
 class ImageData;
 
 /** Clipped rectangle. */
@@ -28,6 +33,7 @@ public:
 	ClippedRectangle();
 	ClippedRectangle(uint16 x, uint16 y, uint16 w, uint16 h);
 	ClippedRectangle(const ClippedRectangle &cr, uint16 x, uint16 y, uint16 w, uint16 h);
+	ClippedRectangle(uint32 *address, int32 pitch, uint16 w, uint16 h);
 
 	ClippedRectangle(const ClippedRectangle &cr);
 	ClippedRectangle &operator=(const ClippedRectangle &cr);
@@ -60,9 +66,11 @@ public:
 	VideoSystem();
 	~VideoSystem();
 
-	std::string Initialize(const char *font_name, int font_size);
+	std::string Initialize(const char *font_name, int font_size, bool headless = false);
 	bool SetResolution(const Point32 &res);
 	void GetResolutions();
+	void SetFramePacing(int frame_rate, bool vsync);
+	void SetStreaming(bool streaming);
 	void MainLoop();
 	void Shutdown();
 
@@ -86,17 +94,28 @@ public:
 		return this->vid_height;
 	}
 
+	/**
+	 * Get the cache of the glyphs and text layouts of the font.
+	 * @return The font cache.
+	 */
+	const FontCache &GetFontCache() const
+	{
+		return this->font_cache;
+	}
+
 	/**
 	 * Query whether the display needs to be repainted.
 	 * @return Display needs an update.
 	 */
 	inline bool DisplayNeedsRepaint()
 	{
-		return this->dirty;
+		return !this->dirty_areas.empty();
 	}
 
 	void MarkDisplayDirty();
 	void MarkDisplayDirty(const Rectangle32 &rect);
+	void GetRepaintAreas(std::vector<Rectangle32> *areas);
+	bool ScrollArea(const Rectangle32 &area, int dx, int dy);
 
 	void SetClippedRectangle(const ClippedRectangle &cr);
 	ClippedRectangle GetClippedRectangle();
@@ -140,8 +159,9 @@ public:
 	}
 
 	void BlitImages(const Point32 &pt, const ImageData *spr, uint16 numx, uint16 numy, const Recolouring &recolour, GradientShift shift = GS_NORMAL);
+	void BlitImages(const ClippedRectangle &cr, const Point32 &pt, const ImageData *spr, uint16 numx, uint16 numy, const Recolouring &recolour, GradientShift shift) const;
 
-	void FinishRepaint();
+	void FinishRepaint(const std::vector<Rectangle32> &areas);
 
 	/**
 	 * Get the height of a line of text.
@@ -167,18 +187,29 @@ private:
 	int vid_height;   ///< Height of the application window.
 	int font_height;  ///< Height of a line of text in pixels.
 	bool initialized; ///< Video system is initialized.
-	bool dirty;       ///< Video display needs being repainted.
+	bool headless;    ///< The display only exists in memory, there is no window.
+	uint32 frame_interval; ///< Minimal number of milliseconds between two rendered frames, \c 0 means no limit.
+	bool vsync;       ///< Synchronize presenting the display with the refresh of the monitor.
+	bool streaming;   ///< Blit directly into the locked #texture instead of into #mem.
+
+	std::vector<Rectangle32> dirty_areas; ///< Non-overlapping areas of the display that need to be repainted.
+	Rectangle32 moved_area;               ///< Area of #mem with moved content that must be copied to the #texture, empty if none.
 
 	TTF_Font *font;             ///< Opened text font.
+	FontCache font_cache;       ///< Rendered glyphs and laid out text of the #font.
 	SDL_Window *window;         ///< %Window of the application.
 	SDL_Renderer *renderer;     ///< GPU renderer to the application window.
 	SDL_Texture *texture;       ///< GPU Texture storage of the application window.
-	uint32 *mem;                ///< Memory used for blitting the application display.
+	uint32 *mem;                ///< Memory used for blitting the application display, if the #texture is not locked.
+	uint32 *display;            ///< Memory of the display being blitted into, either #mem or the locked #texture.
+	int32 display_pitch;        ///< Pitch of a row of the #display, in pixels.
 	ClippedRectangle blit_rect; ///< %Rectangle to blit in.
 	Point16 digit_size;         ///< Size of largest digit (initially a zero-size).
 
+	std::string InitializeFont(const char *font_name, int font_size);
+	void RenderFrame();
+	void UploadArea(Rectangle32 area);
 	bool HandleEvent();
-	void MarkDisplayClean();
 };
 
 extern VideoSystem _video;
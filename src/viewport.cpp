@@ -29,11 +29,15 @@
 #include "terraform.h"
 #include "select_mode.h"
 #include "person.h"
+#include "people.h"
 #include "weather.h"
 #include "fence.h"
 #include "fence_build.h"
+#include "bitmath.h"
+#include "worker_pool.h"
+#include "render_stats.h"
 
-#include <set>
+#include <vector>
 
 /**
  * \page the_world_page World
@@ -199,13 +203,15 @@ public:
 	Rectangle32 rect; ///< Screen area of interest.
 
 protected:
+	void CollectStack(uint xpos, uint ypos, bool use_additions);
+
 	/**
-	 * Decide where supports should be raised.
+	 * Prepare visiting the voxels of a voxel stack.
 	 * @param stack %Voxel stack to examine.
 	 * @param xpos X position of the voxel stack.
 	 * @param ypos Y position of the voxel stack.
 	 */
-	virtual void SetupSupports(const VoxelStack *stack, uint xpos, uint ypos)
+	virtual void SetupStack(const VoxelStack *stack, uint xpos, uint ypos)
 	{
 	}
 
@@ -247,11 +253,429 @@ inline bool operator<(const DrawData &dd1, const DrawData &dd2)
 	return dd1.base.y < dd2.base.y;
 }
 
+/**
+ * Sort key of a #DrawData entry in a #DrawImages collection.
+ * @ingroup viewport_group
+ */
+struct DrawKey {
+	uint64 key;   ///< #DrawData fields packed such that ordering the keys gives the same order as ordering the #DrawData.
+	uint32 index; ///< Index of the #DrawData in DrawImages::data.
+};
+
 /**
  * Collection of sprites to render to the screen.
+ * Sprites are added in arbitrary order, and ordered by viewing distance with #Sort before drawing. Storage is kept
+ * between collect cycles to avoid allocating memory for every drawn frame.
+ * @ingroup viewport_group
+ */
+class DrawImages {
+public:
+	void Clear();
+	void Add(const DrawData &dd);
+	void Sort();
+
+	/**
+	 * Get the number of sprites in the collection.
+	 * @return Number of sprites to draw.
+	 */
+	inline uint Count() const
+	{
+		return this->keys.size();
+	}
+
+	/**
+	 * Get a sprite to draw.
+	 * @param i Index of the sprite in drawing order (if the collection is sorted).
+	 * @return The drawing data of the sprite.
+	 */
+	inline const DrawData &Get(uint i) const
+	{
+		return this->data[this->keys[i].index];
+	}
+
+private:
+	std::vector<DrawData> data;   ///< Drawing data of the sprites, in the order of adding.
+	std::vector<DrawKey> keys;    ///< Sort keys of the sprites, in drawing order after #Sort.
+	std::vector<DrawKey> scratch; ///< Temporary storage during sorting.
+};
+
+/** Remove all sprites from the collection. */
+void DrawImages::Clear()
+{
+	this->data.clear();
+	this->keys.clear();
+}
+
+/**
+ * Pack the fields of drawing data that decide the drawing order into a single number.
+ * @param dd Drawing data of the sprite.
+ * @return Key of the drawing data, ordering the keys gives the same order as ordering the #DrawData.
+ * @ingroup viewport_group
+ */
+static inline uint64 GetDrawKey(const DrawData &dd)
+{
+	/* Key layout: 12 bits level, 16 bits z_height, 12 bits order, 24 bits base.y. Signed fields are offset to make them non-negative. */
+	assert(dd.level >= -0x800 && dd.level < 0x800);
+	assert(dd.order >= 0 && dd.order < 0x1000);
+	assert(dd.base.y >= -0x800000 && dd.base.y < 0x800000);
+
+	return (static_cast<uint64>(dd.level + 0x800) << 52) | (static_cast<uint64>(dd.z_height) << 36) |
+			(static_cast<uint64>(dd.order) << 24) | static_cast<uint64>(dd.base.y + 0x800000);
+}
+
+/**
+ * Add a sprite to the collection.
+ * @param dd Drawing data of the sprite.
+ */
+void DrawImages::Add(const DrawData &dd)
+{
+	DrawKey dk;
+	dk.key = GetDrawKey(dd);
+	dk.index = this->data.size();
+	this->data.push_back(dd);
+	this->keys.push_back(dk);
+}
+
+/**
+ * Order the sprites by viewing distance.
+ * Uses a stable least-significant-digit radix sort on the keys, so sprites with equal keys are drawn in the order of adding.
+ * Digits where all keys are the same are skipped.
+ */
+void DrawImages::Sort()
+{
+	static const int RADIX_BITS = 8;
+	static const int RADIX_COUNT = 8; // Number of digits in a key.
+	static const int RADIX_SIZE = 1 << RADIX_BITS;
+
+	uint count = this->keys.size();
+	if (count < 2) return;
+
+	uint32 histogram[RADIX_COUNT][RADIX_SIZE];
+	memset(histogram, 0, sizeof(histogram));
+	for (const DrawKey &dk : this->keys) {
+		for (int digit = 0; digit < RADIX_COUNT; digit++) histogram[digit][(dk.key >> (digit * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+	}
+
+	this->scratch.resize(count);
+	for (int digit = 0; digit < RADIX_COUNT; digit++) {
+		uint32 *hist = histogram[digit];
+		int shift = digit * RADIX_BITS;
+		if (hist[(this->keys[0].key >> shift) & (RADIX_SIZE - 1)] == count) continue; // All keys have the same digit.
+
+		uint32 offset = 0;
+		for (int i = 0; i < RADIX_SIZE; i++) {
+			uint32 num = hist[i];
+			hist[i] = offset;
+			offset += num;
+		}
+		for (const DrawKey &dk : this->keys) this->scratch[hist[(dk.key >> shift) & (RADIX_SIZE - 1)]++] = dk;
+		this->keys.swap(this->scratch);
+	}
+}
+
+/**
+ * Is the sprite part of the moving content of the world (persons, ride cars, and cursors)?
+ * @param dd Drawing data of the sprite.
+ * @return Whether the sprite is not part of the static layer of the viewport.
+ * @ingroup viewport_group
+ */
+static inline bool IsDynamicSprite(const DrawData &dd)
+{
+	return dd.order == SO_PERSON || dd.order == SO_RIDE_CARS || dd.order == SO_CURSOR;
+}
+
+static const int STATIC_BLOCK_SIZE = 64; ///< Width and height of a block of the static layer, in pixels.
+
+/**
+ * Pre-rendered static content of the world in a viewport, that is, everything except the sprites of #IsDynamicSprite.
+ * The pixels are kept in blocks of #STATIC_BLOCK_SIZE that are rendered on demand. Changes in the world invalidate
+ * the blocks they cover, scrolling moves the valid pixels along with the view.
+ * @ingroup viewport_group
+ */
+class StaticLayer {
+public:
+	StaticLayer();
+	~StaticLayer();
+
+	void Reset(uint16 width, uint16 height);
+	void Invalidate(const Rectangle32 &area);
+	void Scroll(int dx, int dy);
+	bool GetInvalidArea(const Rectangle32 &area, Rectangle32 *invalid) const;
+	void SetValid(const Rectangle32 &area);
+
+	/**
+	 * Get the address of a pixel in the layer.
+	 * @param x Horizontal position of the pixel.
+	 * @param y Vertical position of the pixel.
+	 * @return Address of the pixel.
+	 */
+	inline uint32 *GetPixel(int x, int y)
+	{
+		return this->pixels + x + y * this->width;
+	}
+
+	uint16 width;               ///< Width of the layer in pixels.
+	uint16 height;              ///< Height of the layer in pixels.
+	Point32 origin;             ///< Screen coordinate of the centre of the layer (see #ComputeXFunction and #ComputeYFunction).
+	ViewOrientation orient;     ///< Direction of view of the layer.
+	uint16 tile_width;          ///< Width of a tile in the layer.
+	bool underground_mode;      ///< Whether the layer displays the underground mode.
+	GradientShift shift;        ///< Gradient shift of the layer.
+
+private:
+	uint32 *pixels;             ///< Pixels of the layer, #width by #height.
+	int blocks_x;               ///< Number of blocks in horizontal direction.
+	int blocks_y;               ///< Number of blocks in vertical direction.
+	std::vector<bool> valid;    ///< Blocks with pixels that are up to date.
+	std::vector<bool> scratch;  ///< Temporary storage of block validity during scrolling.
+};
+
+StaticLayer::StaticLayer()
+{
+	this->width = 0;
+	this->height = 0;
+	this->origin = Point32(0, 0);
+	this->orient = VOR_NORTH;
+	this->tile_width = 0;
+	this->underground_mode = false;
+	this->shift = GS_INVALID;
+	this->pixels = nullptr;
+	this->blocks_x = 0;
+	this->blocks_y = 0;
+}
+
+StaticLayer::~StaticLayer()
+{
+	delete[] this->pixels;
+}
+
+/**
+ * Discard all content of the layer.
+ * @param width New width of the layer.
+ * @param height New height of the layer.
+ */
+void StaticLayer::Reset(uint16 width, uint16 height)
+{
+	if (width != this->width || height != this->height) {
+		delete[] this->pixels;
+		this->width = width;
+		this->height = height;
+		this->pixels = new uint32[width * height];
+		this->blocks_x = (width + STATIC_BLOCK_SIZE - 1) / STATIC_BLOCK_SIZE;
+		this->blocks_y = (height + STATIC_BLOCK_SIZE - 1) / STATIC_BLOCK_SIZE;
+	}
+	this->valid.assign(this->blocks_x * this->blocks_y, false);
+}
+
+/**
+ * Mark an area of the layer as out of date.
+ * @param area Area of the layer to invalidate.
+ */
+void StaticLayer::Invalidate(const Rectangle32 &area)
+{
+	int x_min = std::max(FloorDiv(area.base.x, STATIC_BLOCK_SIZE), 0);
+	int y_min = std::max(FloorDiv(area.base.y, STATIC_BLOCK_SIZE), 0);
+	int x_max = std::min(FloorDiv(area.base.x + (int32)area.width - 1, STATIC_BLOCK_SIZE), this->blocks_x - 1);
+	int y_max = std::min(FloorDiv(area.base.y + (int32)area.height - 1, STATIC_BLOCK_SIZE), this->blocks_y - 1);
+	for (int by = y_min; by <= y_max; by++) {
+		for (int bx = x_min; bx <= x_max; bx++) this->valid[bx + by * this->blocks_x] = false;
+	}
+}
+
+/**
+ * Move the content of the layer after the view moved.
+ * Pixels that stay inside the layer are kept, blocks that get content from outside the layer or from an invalid block become invalid.
+ * @param dx Horizontal movement of the view in pixels.
+ * @param dy Vertical movement of the view in pixels.
+ */
+void StaticLayer::Scroll(int dx, int dy)
+{
+	if (abs(dx) >= this->width || abs(dy) >= this->height) {
+		this->valid.assign(this->blocks_x * this->blocks_y, false);
+		return;
+	}
+
+	/* New pixel (x, y) is old pixel (x + dx, y + dy). */
+	int copy_width = this->width - abs(dx);
+	int src_x = std::max(dx, 0);
+	int dest_x = std::max(-dx, 0);
+	if (dy > 0) {
+		for (int y = 0; y < this->height - dy; y++) {
+			memmove(this->GetPixel(dest_x, y), this->GetPixel(src_x, y + dy), copy_width * sizeof(uint32));
+		}
+	} else {
+		for (int y = this->height - 1; y >= -dy; y--) {
+			memmove(this->GetPixel(dest_x, y), this->GetPixel(src_x, y + dy), copy_width * sizeof(uint32));
+		}
+	}
+
+	this->scratch.assign(this->blocks_x * this->blocks_y, false);
+	for (int by = 0; by < this->blocks_y; by++) {
+		int top = by * STATIC_BLOCK_SIZE + dy;
+		int bottom = std::min((by + 1) * STATIC_BLOCK_SIZE, (int)this->height) + dy - 1;
+		if (top < 0 || bottom >= this->height) continue;
+
+		for (int bx = 0; bx < this->blocks_x; bx++) {
+			int left = bx * STATIC_BLOCK_SIZE + dx;
+			int right = std::min((bx + 1) * STATIC_BLOCK_SIZE, (int)this->width) + dx - 1;
+			if (left < 0 || right >= this->width) continue;
+
+			bool is_valid = true;
+			for (int y = top / STATIC_BLOCK_SIZE; is_valid && y <= bottom / STATIC_BLOCK_SIZE; y++) {
+				for (int x = left / STATIC_BLOCK_SIZE; is_valid && x <= right / STATIC_BLOCK_SIZE; x++) {
+					is_valid = this->valid[x + y * this->blocks_x];
+				}
+			}
+			this->scratch[bx + by * this->blocks_x] = is_valid;
+		}
+	}
+	this->valid.swap(this->scratch);
+}
+
+/**
+ * Find the out of date part of an area of the layer.
+ * @param area Area of the layer to examine.
+ * @param invalid [out] Bounding box of the invalid blocks in the \a area, clipped to the layer.
+ * @return Whether the area contains invalid blocks.
+ */
+bool StaticLayer::GetInvalidArea(const Rectangle32 &area, Rectangle32 *invalid) const
+{
+	int x_min = std::max(FloorDiv(area.base.x, STATIC_BLOCK_SIZE), 0);
+	int y_min = std::max(FloorDiv(area.base.y, STATIC_BLOCK_SIZE), 0);
+	int x_max = std::min(FloorDiv(area.base.x + (int32)area.width - 1, STATIC_BLOCK_SIZE), this->blocks_x - 1);
+	int y_max = std::min(FloorDiv(area.base.y + (int32)area.height - 1, STATIC_BLOCK_SIZE), this->blocks_y - 1);
+
+	int left = this->blocks_x;
+	int right = -1;
+	int top = this->blocks_y;
+	int bottom = -1;
+	for (int by = y_min; by <= y_max; by++) {
+		for (int bx = x_min; bx <= x_max; bx++) {
+			if (this->valid[bx + by * this->blocks_x]) continue;
+			left = std::min(left, bx);
+			right = std::max(right, bx);
+			top = std::min(top, by);
+			bottom = std::max(bottom, by);
+		}
+	}
+	if (right < 0) return false;
+
+	*invalid = Rectangle32(left * STATIC_BLOCK_SIZE, top * STATIC_BLOCK_SIZE,
+			(right - left + 1) * STATIC_BLOCK_SIZE, (bottom - top + 1) * STATIC_BLOCK_SIZE);
+	invalid->RestrictTo(0, 0, this->width, this->height);
+	return true;
+}
+
+/**
+ * Mark the blocks of a rendered area as up to date.
+ * @param area Rendered area, must consist of complete blocks (clipped to the layer).
+ */
+void StaticLayer::SetValid(const Rectangle32 &area)
+{
+	int x_max = (area.base.x + area.width - 1) / STATIC_BLOCK_SIZE;
+	int y_max = (area.base.y + area.height - 1) / STATIC_BLOCK_SIZE;
+	for (int by = area.base.y / STATIC_BLOCK_SIZE; by <= y_max; by++) {
+		for (int bx = area.base.x / STATIC_BLOCK_SIZE; bx <= x_max; bx++) this->valid[bx + by * this->blocks_x] = true;
+	}
+}
+
+/**
+ * Static sprite of a voxel in a #StackRenderList, that is, a sprite that is not #IsDynamicSprite.
+ * Its position is relative to the north corner of the voxel at the display.
+ * @ingroup viewport_group
+ */
+struct CachedSprite {
+	const ImageData *sprite;     ///< Sprite to draw.
+	const Recolouring *recolour; ///< Recolouring of the sprite.
+	int16 yoffset;               ///< Vertical offset of the sprite from the north corner of the voxel.
+	uint8 voxel_z;               ///< Height of the voxel of the sprite.
+	uint8 z_height;              ///< Height of the sprite in the drawing order (supports are below their voxel).
+	SpriteOrder order;           ///< Selection when to draw the sprite within the voxel.
+};
+
+/**
+ * Static sprites of a voxel stack.
+ * @ingroup viewport_group
+ */
+struct StackRenderList {
+	bool valid;                        ///< The sprites are up to date.
+	const Voxel *voxels;               ///< Voxels of the stack when the list was made, a different array means the stack was replaced.
+	std::vector<CachedSprite> sprites; ///< Sprites of the voxels of the stack, in increasing voxel height.
+};
+
+/**
+ * Static sprites of the voxel stacks of the world, for a direction of view, tile size, and underground mode.
+ * A list is made when its stack is collected, and dropped when the stack changes (see #Viewport::MarkVoxelDirty).
+ * A list of a stack that got replaced, for example by committing the world additions, is never used.
+ * Collecting the static sprites of a stack is then only a copy of the list.
  * @ingroup viewport_group
  */
-typedef std::multiset<DrawData> DrawImages;
+class RenderLists {
+public:
+	RenderLists();
+
+	void Sync(ViewOrientation orient, uint16 tile_width, bool underground_mode);
+	void Invalidate(int x, int y);
+	void InvalidateAll();
+
+	/**
+	 * Get the render list of a voxel stack.
+	 * @param x X position of the voxel stack.
+	 * @param y Y position of the voxel stack.
+	 * @return Render list of the stack, which may be out of date.
+	 */
+	inline StackRenderList &Get(uint16 x, uint16 y)
+	{
+		return this->stacks[x + y * WORLD_X_SIZE];
+	}
+
+private:
+	ViewOrientation orient;  ///< Direction of view of the lists.
+	uint16 tile_width;       ///< Width of a tile in the lists.
+	bool underground_mode;   ///< Whether the lists display the underground mode.
+	std::vector<StackRenderList> stacks; ///< Render lists of all voxel stacks.
+};
+
+RenderLists::RenderLists()
+{
+	this->orient = VOR_NORTH;
+	this->tile_width = 0;
+	this->underground_mode = false;
+}
+
+/**
+ * Make the render lists match a view, dropping all lists if they do not.
+ * @param orient Direction of view.
+ * @param tile_width Width of a tile.
+ * @param underground_mode Whether the view displays the underground mode.
+ */
+void RenderLists::Sync(ViewOrientation orient, uint16 tile_width, bool underground_mode)
+{
+	if (orient == this->orient && tile_width == this->tile_width && underground_mode == this->underground_mode) return;
+
+	this->orient = orient;
+	this->tile_width = tile_width;
+	this->underground_mode = underground_mode;
+	this->stacks.resize(WORLD_X_SIZE * WORLD_Y_SIZE);
+	for (StackRenderList &srl : this->stacks) srl.valid = false;
+}
+
+/**
+ * Drop the render list of a voxel stack after it changed.
+ * @param x X position of the voxel stack.
+ * @param y Y position of the voxel stack.
+ */
+void RenderLists::Invalidate(int x, int y)
+{
+	if (this->stacks.empty() || x < 0 || x >= WORLD_X_SIZE || y < 0 || y >= WORLD_Y_SIZE) return;
+	this->Get(x, y).valid = false;
+}
+
+/** Drop the render lists of all voxel stacks. */
+void RenderLists::InvalidateAll()
+{
+	for (StackRenderList &srl : this->stacks) srl.valid = false;
+}
 
 /**
  * Collect sprites to draw in a viewport.
@@ -264,14 +688,16 @@ public:
 
 	void SetXYOffset(int16 xoffset, int16 yoffset);
 
-	DrawImages draw_images; ///< Sprites to draw ordered by viewing distance.
+	DrawImages *draw_images; ///< Sprites to draw ordered by viewing distance (storage is owned by the viewport).
 	int16 xoffset; ///< Horizontal offset of the top-left coordinate to the top-left of the display.
 	int16 yoffset; ///< Vertical offset of the top-left coordinate to the top-left of the display.
 	bool enable_cursors; ///< Enable cursor drawing.
 
 protected:
 	void CollectVoxel(const Voxel *vx, const XYZPoint16 &voxel_pos, int32 xnorth, int32 ynorth) override;
-	void SetupSupports(const VoxelStack *stack, uint xpos, uint ypos) override;
+	void SetupStack(const VoxelStack *stack, uint xpos, uint ypos) override;
+	void MakeRenderList(const VoxelStack *stack, std::vector<CachedSprite> *list);
+	void AddStaticSprites(const Voxel *voxel, uint8 zpos, std::vector<CachedSprite> *list);
 	const ImageData *GetCursorSpriteAtPos(const XYZPoint16 &voxel_pos, uint8 tslope, uint8 &yoffset);
 
 	/** For each orientation the location of the real northern corner of a tile relative to the northern displayed corner. */
@@ -279,6 +705,11 @@ protected:
 
 	uint16 ground_height; ///< The height of the ground in the current voxel stack. \c -1 means no valid ground found.
 	uint8 ground_slope;   ///< Imploded ground slope if #ground_height is valid.
+
+	RenderLists *render_lists;            ///< Render lists of the voxel stacks (owned by the viewport).
+	std::vector<CachedSprite> scratch;    ///< Render list of a voxel stack that is not cached.
+	const CachedSprite *next_sprite;      ///< Next static sprite of the current voxel stack.
+	const CachedSprite *end_sprite;       ///< End of the static sprites of the current voxel stack.
 };
 
 /**
@@ -300,6 +731,27 @@ protected:
 	void CollectVoxel(const Voxel *vx, const XYZPoint16 &voxel_pos, int32 xnorth, int32 ynorth) override;
 };
 
+/**
+ * Fill a block of the pick layer of a viewport, with for each pixel the handle of the sprite that a #PixelFinder
+ * would find at that pixel (see #MakePickHandle). Persons are not supported, they move too often to keep their pixels.
+ * @ingroup viewport_group
+ */
+class PickCollector : public VoxelCollector {
+public:
+	PickCollector(Viewport *vp, ClickableSprite allowed, StaticLayer *layer, const Rectangle32 &block);
+	~PickCollector();
+
+	ClickableSprite allowed; ///< Sprite types looking for.
+
+protected:
+	void CollectVoxel(const Voxel *vx, const XYZPoint16 &voxel_pos, int32 xnorth, int32 ynorth) override;
+	void AddSprite(DrawData &dd, const ImageData *spr, const XYZPoint16 &voxel_pos, int32 xnorth, int32 ynorth);
+
+	uint32 *handles;           ///< Handle of the top-left pixel of the block in the pick layer.
+	uint16 pitch;              ///< Number of handles between two rows of the block.
+	std::vector<uint64> keys;  ///< Draw key of the sprite found at each pixel of the block (see #GetDrawKey).
+};
+
 /**
  * Base class constructor.
  * @param vp %Viewport querying the voxel information.
@@ -340,44 +792,99 @@ void VoxelCollector::SetWindowSize(int16 xpos, int16 ypos, uint16 width, uint16
 	this->rect.height = height;
 }
 
+/**
+ * Screen column of a voxel stack for each orientation, as multiples of the x and y position of the north corner.
+ * The horizontal screen position of the north corner is the column times half the tile width.
+ */
+static const Point16 _stack_column[4] = {{-1, 1}, {1, 1}, {1, -1}, {-1, -1}};
+
+/**
+ * Screen row (diagonal slice) of a voxel stack for each orientation, as multiples of the x and y position of the north corner.
+ * The vertical screen position of the north corner at height \c 0 is the row times a quarter of the tile width.
+ */
+static const Point16 _stack_row[4] = {{1, 1}, {1, -1}, {-1, -1}, {-1, 1}};
+
 /**
  * Perform the collecting cycle.
  * This part walks over the voxels, and call #CollectVoxel for each useful voxel.
  * A derived class may then inspect the voxel in more detail.
+ *
+ * Rather than walking the whole world, the range of screen columns and rows (diagonal slices) that may intersect
+ * with #rect is computed first, and only the voxel stacks at those positions are visited. The amount of work thus
+ * depends on the size of the window rather than on the size of the world.
+ * Within a row, stacks are visited in increasing x order, like a plain walk over the world would do.
  * @param use_additions Use the #_additions voxels for drawing.
- * @todo Do this less stupid. Walking the whole world is not going to work in general.
  */
 void VoxelCollector::Collect(bool use_additions)
 {
-	for (uint xpos = 0; xpos < _world.GetXSize(); xpos++) {
-		int32 world_x = (xpos + ((this->orient == VOR_SOUTH || this->orient == VOR_WEST) ? 1 : 0)) * 256;
-		for (uint ypos = 0; ypos < _world.GetYSize(); ypos++) {
-			int32 world_y = (ypos + ((this->orient == VOR_SOUTH || this->orient == VOR_EAST) ? 1 : 0)) * 256;
-			int32 north_x = ComputeX(world_x, world_y);
-			if (north_x + this->tile_width / 2 <= (int32)this->rect.base.x) continue; // Right of voxel column is at left of window.
-			if (north_x - this->tile_width / 2 >= (int32)(this->rect.base.x + this->rect.width)) continue; // Left of the window.
-
-			const VoxelStack *stack = use_additions ? _additions.GetStack(xpos, ypos) : _world.GetStack(xpos, ypos);
-			this->SetupSupports(stack, xpos, ypos);
-			uint zpos = stack->base;
-			for (int count = 0; count < stack->height; zpos++, count++) {
-				int32 north_y = this->ComputeY(world_x, world_y, zpos * 256);
-				if (north_y - this->tile_height >= (int32)(this->rect.base.y + this->rect.height)) continue; // Voxel is below the window.
-				if (north_y + this->tile_width / 2 + this->tile_height <= (int32)this->rect.base.y) break; // Above the window and rising!
-
-				this->CollectVoxel(&stack->voxels[count], XYZPoint16(xpos, ypos, zpos), north_x, north_y);
-			}
-			/* Possibly cursors should be drawn above this. */
-			if (this->draw_above_stack) {
-				uint8 zmax = this->vp->GetMaxCursorHeight(xpos, ypos, (zpos == 0) ? zpos : zpos - 1);
-				for (; zpos <= zmax; zpos++) {
-					int32 north_y = this->ComputeY(world_x, world_y, zpos * 256);
-					if (north_y - this->tile_height >= (int32)(this->rect.base.y + this->rect.height)) continue; // Voxel is below the window.
-					if (north_y + this->tile_width / 2 + this->tile_height <= (int32)this->rect.base.y) break; // Above the window and rising!
-
-					this->CollectVoxel(nullptr, XYZPoint16(xpos, ypos, zpos), north_x, north_y);
-				}
+	const int32 half_width = this->tile_width / 2;
+	const int32 quarter_width = this->tile_width / 4;
+	const Point16 &col = _stack_column[this->orient];
+	const Point16 &row = _stack_row[this->orient];
+	const int xoff = (this->orient == VOR_SOUTH || this->orient == VOR_WEST) ? 1 : 0;
+	const int yoff = (this->orient == VOR_SOUTH || this->orient == VOR_EAST) ? 1 : 0;
+
+	/* A stack is at most half a tile wide at both sides of its north corner. */
+	int32 col_min = FloorDiv(this->rect.base.x, half_width);
+	int32 col_max = FloorDiv(this->rect.base.x + this->rect.width, half_width) + 1;
+
+	/* The bottom voxel must not be above the window, the highest possible voxel must not be below it. */
+	int32 row_min = FloorDiv(this->rect.base.y - half_width - this->tile_height, quarter_width);
+	int32 row_max = FloorDiv(this->rect.base.y + this->rect.height + (WORLD_Z_SIZE + 1) * this->tile_height, quarter_width) + 1;
+
+	/* Column and row of a stack always have the same parity. Walk the columns in the direction of increasing x. */
+	int col_step = (row.y > 0) ? -2 : 2;
+	for (int32 r = row_min; r <= row_max; r++) {
+		int32 c_first = col_min + ((col_min ^ r) & 1);
+		int32 c_last  = col_max - ((col_max ^ r) & 1);
+		if (c_first > c_last) continue;
+		if (col_step < 0) std::swap(c_first, c_last);
+
+		for (int32 c = c_first; ; c += col_step) {
+			/* Invert the column/row transformation, the determinant is -2 in all orientations. */
+			int32 xpos = (col.y * r - row.y * c) / 2 - xoff;
+			int32 ypos = (row.x * c - col.x * r) / 2 - yoff;
+			if (xpos >= 0 && xpos < _world.GetXSize() && ypos >= 0 && ypos < _world.GetYSize()) {
+				this->CollectStack(xpos, ypos, use_additions);
 			}
+			if (c == c_last) break;
+		}
+	}
+}
+
+/**
+ * Visit the voxels of a single voxel stack, and call #CollectVoxel for each voxel that may be visible in #rect.
+ * @param xpos X position of the voxel stack.
+ * @param ypos Y position of the voxel stack.
+ * @param use_additions Use the #_additions voxels for drawing.
+ */
+void VoxelCollector::CollectStack(uint xpos, uint ypos, bool use_additions)
+{
+	int32 world_x = (xpos + ((this->orient == VOR_SOUTH || this->orient == VOR_WEST) ? 1 : 0)) * 256;
+	int32 world_y = (ypos + ((this->orient == VOR_SOUTH || this->orient == VOR_EAST) ? 1 : 0)) * 256;
+	int32 north_x = ComputeX(world_x, world_y);
+	if (north_x + this->tile_width / 2 <= (int32)this->rect.base.x) return; // Right of voxel column is at left of window.
+	if (north_x - this->tile_width / 2 >= (int32)(this->rect.base.x + this->rect.width)) return; // Left of the window.
+
+	const VoxelStack *stack = use_additions ? _additions.GetStack(xpos, ypos) : _world.GetStack(xpos, ypos);
+	this->SetupStack(stack, xpos, ypos);
+	uint zpos = stack->base;
+	for (int count = 0; count < stack->height; zpos++, count++) {
+		int32 north_y = this->ComputeY(world_x, world_y, zpos * 256);
+		if (north_y - this->tile_height >= (int32)(this->rect.base.y + this->rect.height)) continue; // Voxel is below the window.
+		if (north_y + this->tile_width / 2 + this->tile_height <= (int32)this->rect.base.y) break; // Above the window and rising!
+
+		this->CollectVoxel(&stack->voxels[count], XYZPoint16(xpos, ypos, zpos), north_x, north_y);
+	}
+	/* Possibly cursors should be drawn above this. */
+	if (this->draw_above_stack) {
+		uint8 zmax = this->vp->GetMaxCursorHeight(xpos, ypos, (zpos == 0) ? zpos : zpos - 1);
+		for (; zpos <= zmax; zpos++) {
+			int32 north_y = this->ComputeY(world_x, world_y, zpos * 256);
+			if (north_y - this->tile_height >= (int32)(this->rect.base.y + this->rect.height)) continue; // Voxel is below the window.
+			if (north_y + this->tile_width / 2 + this->tile_height <= (int32)this->rect.base.y) break; // Above the window and rising!
+
+			this->CollectVoxel(nullptr, XYZPoint16(xpos, ypos, zpos), north_x, north_y);
 		}
 	}
 }
@@ -439,10 +946,15 @@ void Viewport::TimeoutCallback()
  */
 SpriteCollector::SpriteCollector(Viewport *vp, bool enable_cursors) : VoxelCollector(vp, true)
 {
-	this->draw_images.clear();
+	this->draw_images = vp->draw_images;
+	this->draw_images->Clear();
 	this->xoffset = 0;
 	this->yoffset = 0;
 	this->enable_cursors = enable_cursors;
+	this->render_lists = vp->render_lists;
+	this->render_lists->Sync(this->orient, this->tile_width, this->underground_mode);
+	this->next_sprite = nullptr;
+	this->end_sprite = nullptr;
 
 	this->north_offsets[VOR_NORTH].x = 0;                     this->north_offsets[VOR_NORTH].y = 0;
 	this->north_offsets[VOR_EAST].x  = -this->tile_width / 2; this->north_offsets[VOR_EAST].y  = this->tile_width / 4;
@@ -497,7 +1009,7 @@ Cursor::Cursor(Viewport *vp) : BaseCursor(vp)
 
 void Cursor::MarkDirty()
 {
-	if (this->type != CUR_TYPE_INVALID) this->vp->MarkVoxelDirty(this->cursor_pos);
+	if (this->type != CUR_TYPE_INVALID) this->vp->MarkVoxelDisplayDirty(this->cursor_pos);
 }
 
 /**
@@ -590,7 +1102,7 @@ void MultiCursor::MarkDirty()
 
 	for (uint x = 0; x < this->rect.width; x++) {
 		for (uint y = 0; y < this->rect.height; y++) {
-			this->vp->MarkVoxelDirty(XYZPoint16(this->rect.base.x + x, this->rect.base.y + y,
+			this->vp->MarkVoxelDisplayDirty(XYZPoint16(this->rect.base.x + x, this->rect.base.y + y,
 					this->GetZpos(this->rect.base.x + x, this->rect.base.y + y)));
 		}
 	}
@@ -667,7 +1179,7 @@ EdgeCursor::EdgeCursor(Viewport *vp) : BaseCursor(vp)
 
 void EdgeCursor::MarkDirty()
 {
-	if (this->type != CUR_TYPE_INVALID) this->vp->MarkVoxelDirty(this->cursor_pos);
+	if (this->type != CUR_TYPE_INVALID) this->vp->MarkVoxelDisplayDirty(this->cursor_pos);
 }
 
 /**
@@ -797,20 +1309,53 @@ const ImageData *SpriteCollector::GetCursorSpriteAtPos(const XYZPoint16 &voxel_p
 	}
 }
 
-void SpriteCollector::SetupSupports(const VoxelStack *stack, uint xpos, uint ypos)
+/**
+ * Find the static sprites of a voxel stack, making its render list if it is out of date.
+ * Stacks of the world additions are not cached, as they are temporary.
+ * @param stack %Voxel stack to examine.
+ * @param xpos X position of the voxel stack.
+ * @param ypos Y position of the voxel stack.
+ */
+void SpriteCollector::SetupStack(const VoxelStack *stack, uint xpos, uint ypos)
+{
+	const std::vector<CachedSprite> *list;
+	if (stack == _world.GetStack(xpos, ypos)) {
+		StackRenderList &srl = this->render_lists->Get(xpos, ypos);
+		if (!srl.valid || srl.voxels != stack->voxels) {
+			this->MakeRenderList(stack, &srl.sprites);
+			srl.voxels = stack->voxels;
+			srl.valid = true;
+		}
+		list = &srl.sprites;
+	} else {
+		this->MakeRenderList(stack, &this->scratch);
+		list = &this->scratch;
+	}
+	this->next_sprite = list->data();
+	this->end_sprite = list->data() + list->size();
+}
+
+/**
+ * Make the render list of a voxel stack.
+ * @param stack %Voxel stack to examine.
+ * @param list [out] Static sprites of the voxels of the stack.
+ */
+void SpriteCollector::MakeRenderList(const VoxelStack *stack, std::vector<CachedSprite> *list)
 {
+	/* Supports are raised from the ground in the stack. */
+	this->ground_height = -1;
 	for (uint i = 0; i < stack->height; i++) {
 		const Voxel *v = &stack->voxels[i];
 		if (v->GetGroundType() == GTP_INVALID) continue;
 		if (v->GetInstance() == SRI_FREE) {
 			this->ground_height = stack->base + i;
 			this->ground_slope = _slope_rotation[v->GetGroundSlope()][this->orient];
-			return;
 		}
 		break;
 	}
-	this->ground_height = -1;
-	return;
+
+	list->clear();
+	for (uint i = 0; i < stack->height; i++) this->AddStaticSprites(&stack->voxels[i], stack->base + i, list);
 }
 
 /**
@@ -820,31 +1365,33 @@ void SpriteCollector::SetupSupports(const VoxelStack *stack, uint xpos, uint ypo
  * @param basex X position of the sprite in the screen.
  * @param basey Y position of the sprite in the screen.
  * @param orient View orientation.
+ * @param sprites Sprites at the size of the view.
  * @param number Ride instance number.
  * @param voxel_number Number of the voxel.
  * @param dd [out] Data to draw (4 entries).
  * @param platform [out] Shape of the support platform, if needed. @see PathSprites
  * @return The number of \a dd entries filled.
  */
-static int DrawRide(int32 slice, int zpos, int32 basex, int32 basey, ViewOrientation orient, uint16 number, uint16 voxel_number, DrawData *dd, uint8 *platform)
+static int DrawRide(int32 slice, int zpos, int32 basex, int32 basey, ViewOrientation orient, const SpriteStorage *sprites, uint16 number, uint16 voxel_number, DrawData *dd, uint8 *platform)
 {
 	const RideInstance *ri = _rides_manager.GetRideInstance(number);
 	if (ri == nullptr) return 0;
 	/* Shops are connected in every direction. */
 	if (platform != nullptr) *platform = (ri->GetKind() == RTK_SHOP) ? PATH_NE_NW_SE_SW : PATH_INVALID;
 
-	const ImageData *sprites[4];
-	ri->GetSprites(voxel_number, orient, sprites);
+	const ImageData *ride_sprites[4];
+	ri->GetSprites(voxel_number, orient, ride_sprites);
 
 	int idx = 0;
 	static const SpriteOrder sprite_numbers[4] = {SO_PLATFORM_BACK, SO_RIDE, SO_RIDE_FRONT, SO_PLATFORM_FRONT};
 	for (int i = 0; i < 4; i++) {
-		if (sprites[i] == nullptr) continue;
+		const ImageData *spr = sprites->ScaleSprite(ride_sprites[i]);
+		if (spr == nullptr) continue;
 
 		dd[idx].level = slice;
 		dd[idx].z_height = zpos;
 		dd[idx].order = sprite_numbers[i];
-		dd[idx].sprite = sprites[i];
+		dd[idx].sprite = spr;
 		dd[idx].base.x = basex;
 		dd[idx].base.y = basey;
 		dd[idx].recolour = &ri->recolours;
@@ -854,61 +1401,49 @@ static int DrawRide(int32 slice, int zpos, int32 basex, int32 basey, ViewOrienta
 }
 
 /**
- * Add all sprites of the voxel to the set of sprites to draw.
- * @param voxel %Voxel to add, \c nullptr means 'cursor above stack'.
- * @param voxel_pos World position.
- * @param xnorth X coordinate of the north corner at the display.
- * @param ynorth y coordinate of the north corner at the display.
- * @todo Can we gain time by checking for cursors once at every voxel stack, and only test every \a zpos when there is one in a stack?
+ * Add a sprite to a render list.
+ * @param list Render list to extend.
+ * @param spr Sprite to add, nothing is added if \c nullptr.
+ * @param zpos Height of the voxel of the sprite.
+ * @param order Selection when to draw the sprite within the voxel.
+ * @param yoffset Vertical offset of the sprite from the north corner of the voxel.
+ * @param z_height Height of the sprite in the drawing order.
+ * @param recolour Recolouring of the sprite.
  */
-void SpriteCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_pos, int32 xnorth, int32 ynorth)
+static void AddCachedSprite(std::vector<CachedSprite> *list, const ImageData *spr, uint8 zpos, SpriteOrder order, int16 yoffset, uint8 z_height, const Recolouring *recolour = nullptr)
 {
-	int32 slice;
-	switch (this->orient) {
-		case 0: slice =  voxel_pos.x + voxel_pos.y; break;
-		case 1: slice =  voxel_pos.x - voxel_pos.y; break;
-		case 2: slice = -voxel_pos.x - voxel_pos.y; break;
-		case 3: slice = -voxel_pos.x + voxel_pos.y; break;
-		default: NOT_REACHED();
-	}
+	if (spr == nullptr) return;
 
-	if (voxel == nullptr) { // Draw cursor above stack.
-		uint8 yoffset = 0;
-		const ImageData *mspr = this->GetCursorSpriteAtPos(voxel_pos, SL_FLAT, yoffset);
-		if (mspr != nullptr) {
-			DrawData dd;
-			dd.level = slice;
-			dd.z_height = voxel_pos.z;
-			dd.order = SO_CURSOR;
-			dd.sprite = mspr;
-			dd.base.x = this->xoffset + xnorth - this->rect.base.x;
-			dd.base.y = this->yoffset + ynorth - this->rect.base.y + yoffset;
-			dd.recolour = nullptr;
-			this->draw_images.insert(dd);
-		}
-		return;
-	}
+	CachedSprite cs;
+	cs.sprite = spr;
+	cs.recolour = recolour;
+	cs.yoffset = yoffset;
+	cs.voxel_z = zpos;
+	cs.z_height = z_height;
+	cs.order = order;
+	list->push_back(cs);
+}
 
+/**
+ * Add the static sprites of a voxel to a render list, that is, everything except cursors and voxel objects.
+ * @param voxel %Voxel to add.
+ * @param zpos Height of the voxel.
+ * @param list Render list to extend.
+ * @pre #ground_height and #ground_slope are set for the stack of the voxel, see #MakeRenderList.
+ */
+void SpriteCollector::AddStaticSprites(const Voxel *voxel, uint8 zpos, std::vector<CachedSprite> *list)
+{
 	uint8 platform_shape = PATH_INVALID;
 	SmallRideInstance sri = voxel->GetInstance();
 	uint16 instance_data = voxel->GetInstanceData();
 	if (sri == SRI_PATH && HasValidPath(instance_data)) { // A path (and not something reserved above it).
-		DrawData dd;
-		dd.level = slice;
-		dd.z_height = voxel_pos.z;
-		dd.order = SO_PATH;
 		platform_shape = _path_rotation[GetImplodedPathSlope(instance_data)][this->orient];
-		dd.sprite = this->sprites->GetPathSprite(GetPathType(instance_data), GetImplodedPathSlope(instance_data), this->orient);
-		dd.base.x = this->xoffset + xnorth - this->rect.base.x;
-		dd.base.y = this->yoffset + ynorth - this->rect.base.y;
-		dd.recolour = nullptr;
-		this->draw_images.insert(dd);
+		const ImageData *spr = this->sprites->GetPathSprite(GetPathType(instance_data), GetImplodedPathSlope(instance_data), this->orient);
+		AddCachedSprite(list, spr, zpos, SO_PATH, 0, zpos);
 	} else if (sri >= SRI_FULL_RIDES) { // A normal ride.
 		DrawData dd[4];
-		int count = DrawRide(slice, voxel_pos.z,
-				this->xoffset + xnorth - this->rect.base.x, this->yoffset + ynorth - this->rect.base.y,
-				this->orient, sri, instance_data, dd, &platform_shape);
-		for (int i = 0; i < count; i++) this->draw_images.insert(dd[i]);
+		int count = DrawRide(0, zpos, 0, 0, this->orient, this->sprites, sri, instance_data, dd, &platform_shape);
+		for (int i = 0; i < count; i++) AddCachedSprite(list, dd[i].sprite, zpos, dd[i].order, 0, zpos, dd[i].recolour);
 	}
 
 	/* Foundations. */
@@ -923,50 +1458,15 @@ void SpriteCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_p
 			default: NOT_REACHED();
 		}
 		const Foundation *fnd = &this->sprites->foundation[FDT_GROUND];
-		if (sw != 0) {
-			const ImageData *img = fnd->sprites[3 + sw - 1];
-			if (img != nullptr) {
-				DrawData dd;
-				dd.level = slice;
-				dd.z_height = voxel_pos.z;
-				dd.order = SO_FOUNDATION;
-				dd.sprite = img;
-				dd.base.x = this->xoffset + xnorth - this->rect.base.x;
-				dd.base.y = this->yoffset + ynorth - this->rect.base.y;
-				dd.recolour = nullptr;
-				this->draw_images.insert(dd);
-			}
-		}
-		if (se != 0) {
-			const ImageData *img = fnd->sprites[se - 1];
-			if (img != nullptr) {
-				DrawData dd;
-				dd.level = slice;
-				dd.z_height = voxel_pos.z;
-				dd.order = SO_FOUNDATION;
-				dd.sprite = img;
-				dd.base.x = this->xoffset + xnorth - this->rect.base.x;
-				dd.base.y = this->yoffset + ynorth - this->rect.base.y;
-				dd.recolour = nullptr;
-				this->draw_images.insert(dd);
-			}
-		}
+		if (sw != 0) AddCachedSprite(list, fnd->sprites[3 + sw - 1], zpos, SO_FOUNDATION, 0, zpos);
+		if (se != 0) AddCachedSprite(list, fnd->sprites[se - 1], zpos, SO_FOUNDATION, 0, zpos);
 	}
 
 	/* Ground surface. */
-	uint8 gslope = SL_FLAT;
 	if (voxel->GetGroundType() != GTP_INVALID) {
-		DrawData dd;
-		dd.level = slice;
-		dd.z_height = voxel_pos.z;
-		dd.order = SO_GROUND;
 		uint8 slope = voxel->GetGroundSlope();
 		uint8 type = (this->underground_mode) ? GTP_UNDERGROUND : voxel->GetGroundType();
-		dd.sprite = this->sprites->GetSurfaceSprite(type, slope, this->orient);
-		dd.base.x = this->xoffset + xnorth - this->rect.base.x;
-		dd.base.y = this->yoffset + ynorth - this->rect.base.y;
-		dd.recolour = nullptr;
-		this->draw_images.insert(dd);
+		AddCachedSprite(list, this->sprites->GetSurfaceSprite(type, slope, this->orient), zpos, SO_GROUND, 0, zpos);
 		switch (slope) {
 			// XXX There are no sprites for partial support of a platform.
 			case SL_FLAT:
@@ -993,21 +1493,15 @@ void SpriteCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_p
 				platform_shape = PATH_INVALID;
 				break;
 		}
-
-		gslope = voxel->GetGroundSlope();
 	}
 
 	/* Fences */
 	for (TileEdge edge = EDGE_BEGIN; edge < EDGE_COUNT; edge++) {
 		FenceType fence_type = voxel->GetFenceType(edge);
 		if (fence_type != FENCE_TYPE_INVALID) {
-			DrawData dd;
-			dd.level = slice;
-			dd.z_height = voxel_pos.z;
-			dd.order = (edge + 4 * this->orient + 1) % 4 < EDGE_SW ? SO_FENCE_BACK : SO_FENCE_FRONT;
+			SpriteOrder order = (edge + 4 * this->orient + 1) % 4 < EDGE_SW ? SO_FENCE_BACK : SO_FENCE_FRONT;
 			TileSlope slope = ExpandTileSlope(voxel->GetGroundSlope());
-			dd.sprite = this->sprites->GetFenceSprite(fence_type, edge, slope, this->orient);
-			int32 extra_y = 0;
+			int16 extra_y = 0;
 			if ((slope & TSB_STEEP) != 0) {
 				/* Is lower edge of steep slope? */
 				uint8 corner_height[4];
@@ -1017,28 +1511,10 @@ void SpriteCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_p
 					extra_y = this->tile_height;
 				}
  			}
-			dd.base.x = this->xoffset + xnorth - this->rect.base.x;
-			dd.base.y = this->yoffset + ynorth - this->rect.base.y + extra_y;
-			dd.recolour = nullptr;
-			this->draw_images.insert(dd);
+			AddCachedSprite(list, this->sprites->GetFenceSprite(fence_type, edge, slope, this->orient), zpos, order, extra_y, zpos);
 		}
 	}
 
-	/* Sprite cursor (arrow) */
-	uint8 cursor_yoffset = 0;
-	const ImageData *mspr = this->GetCursorSpriteAtPos(voxel_pos, gslope, cursor_yoffset);
-	if (mspr != nullptr) {
-		DrawData dd;
-		dd.level = slice;
-		dd.z_height = voxel_pos.z;
-		dd.order = SO_CURSOR;
-		dd.sprite = mspr;
-		dd.base.x = this->xoffset + xnorth - this->rect.base.x;
-		dd.base.y = this->yoffset + ynorth - this->rect.base.y + cursor_yoffset;
-		dd.recolour = nullptr;
-		this->draw_images.insert(dd);
-	}
-
 	/* Add platforms. */
 	if (platform_shape != PATH_INVALID) {
 		/* Platform gets automatically added when drawing a path or ride, without drawing ground. */
@@ -1050,17 +1526,7 @@ void SpriteCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_p
 			case PATH_RAMP_SW: pl_spr = this->sprites->platform.ramp[0]; break;
 			default: pl_spr = this->sprites->platform.flat[this->orient & 1]; break;
 		}
-		if (pl_spr != nullptr) {
-			DrawData dd;
-			dd.level = slice;
-			dd.z_height = voxel_pos.z;
-			dd.order = SO_PLATFORM;
-			dd.sprite = pl_spr;
-			dd.base.x = this->xoffset + xnorth - this->rect.base.x;
-			dd.base.y = this->yoffset + ynorth - this->rect.base.y;
-			dd.recolour = nullptr;
-			this->draw_images.insert(dd);
-		}
+		AddCachedSprite(list, pl_spr, zpos, SO_PLATFORM, 0, zpos);
 
 		/* XXX Use the shape to draw handle bars. */
 
@@ -1068,11 +1534,11 @@ void SpriteCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_p
 		uint16 height = this->ground_height;
 		this->ground_height = -1;
 		uint8 slope = this->ground_slope;
-		while (height < voxel_pos.z) {
-			int yoffset = (voxel_pos.z - height) * this->vp->tile_height; // Compensate y position of support.
+		while (height < zpos) {
+			int yoffset = (zpos - height) * this->tile_height; // Compensate y position of support.
 			uint sprnum;
 			if (slope == SL_FLAT) {
-				if (height + 1 < voxel_pos.z) {
+				if (height + 1 < zpos) {
 					sprnum = SSP_FLAT_DOUBLE_NS + (this->orient & 1);
 					height += 2;
 				} else {
@@ -1089,20 +1555,77 @@ void SpriteCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_p
 				}
 				slope = SL_FLAT;
 			}
-			ImageData *img = this->sprites->support.sprites[sprnum];
-			if (img != nullptr) {
-				DrawData dd;
-				dd.level = slice;
-				dd.z_height = height;
-				dd.order = SO_SUPPORT;
-				dd.sprite = img;
-				dd.base.x = this->xoffset + xnorth - this->rect.base.x;
-				dd.base.y = this->yoffset + ynorth - this->rect.base.y + yoffset;
-				dd.recolour = nullptr;
-				this->draw_images.insert(dd);
-			}
+			AddCachedSprite(list, this->sprites->support.sprites[sprnum], zpos, SO_SUPPORT, yoffset, height);
 		}
 	}
+}
+
+/**
+ * Add all sprites of the voxel to the set of sprites to draw.
+ * The static sprites are copied from the render list of the voxel stack, see #SetupStack.
+ * @param voxel %Voxel to add, \c nullptr means 'cursor above stack'.
+ * @param voxel_pos World position.
+ * @param xnorth X coordinate of the north corner at the display.
+ * @param ynorth y coordinate of the north corner at the display.
+ * @todo Can we gain time by checking for cursors once at every voxel stack, and only test every \a zpos when there is one in a stack?
+ */
+void SpriteCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_pos, int32 xnorth, int32 ynorth)
+{
+	int32 slice;
+	switch (this->orient) {
+		case 0: slice =  voxel_pos.x + voxel_pos.y; break;
+		case 1: slice =  voxel_pos.x - voxel_pos.y; break;
+		case 2: slice = -voxel_pos.x - voxel_pos.y; break;
+		case 3: slice = -voxel_pos.x + voxel_pos.y; break;
+		default: NOT_REACHED();
+	}
+
+	if (voxel == nullptr) { // Draw cursor above stack.
+		uint8 yoffset = 0;
+		const ImageData *mspr = this->GetCursorSpriteAtPos(voxel_pos, SL_FLAT, yoffset);
+		if (mspr != nullptr) {
+			DrawData dd;
+			dd.level = slice;
+			dd.z_height = voxel_pos.z;
+			dd.order = SO_CURSOR;
+			dd.sprite = mspr;
+			dd.base.x = this->xoffset + xnorth - this->rect.base.x;
+			dd.base.y = this->yoffset + ynorth - this->rect.base.y + yoffset;
+			dd.recolour = nullptr;
+			this->draw_images->Add(dd);
+		}
+		return;
+	}
+
+	/* Static sprites, voxels below the window have been skipped. */
+	while (this->next_sprite != this->end_sprite && this->next_sprite->voxel_z < voxel_pos.z) this->next_sprite++;
+	for (; this->next_sprite != this->end_sprite && this->next_sprite->voxel_z == voxel_pos.z; this->next_sprite++) {
+		DrawData dd;
+		dd.level = slice;
+		dd.z_height = this->next_sprite->z_height;
+		dd.order = this->next_sprite->order;
+		dd.sprite = this->next_sprite->sprite;
+		dd.base.x = this->xoffset + xnorth - this->rect.base.x;
+		dd.base.y = this->yoffset + ynorth - this->rect.base.y + this->next_sprite->yoffset;
+		dd.recolour = this->next_sprite->recolour;
+		this->draw_images->Add(dd);
+	}
+
+	/* Sprite cursor (arrow) */
+	uint8 gslope = (voxel->GetGroundType() != GTP_INVALID) ? voxel->GetGroundSlope() : SL_FLAT;
+	uint8 cursor_yoffset = 0;
+	const ImageData *mspr = this->GetCursorSpriteAtPos(voxel_pos, gslope, cursor_yoffset);
+	if (mspr != nullptr) {
+		DrawData dd;
+		dd.level = slice;
+		dd.z_height = voxel_pos.z;
+		dd.order = SO_CURSOR;
+		dd.sprite = mspr;
+		dd.base.x = this->xoffset + xnorth - this->rect.base.x;
+		dd.base.y = this->yoffset + ynorth - this->rect.base.y + cursor_yoffset;
+		dd.recolour = nullptr;
+		this->draw_images->Add(dd);
+	}
 
 	/* Add voxel objects (persons, ride cars, etc). */
 	const VoxelObject *vo = voxel->voxel_objects;
@@ -1118,7 +1641,7 @@ void SpriteCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_p
 			dd.sprite = anim_spr;
 			dd.base.x = this->xoffset + this->north_offsets[this->orient].x + xnorth - this->rect.base.x + x_off;
 			dd.base.y = this->yoffset + this->north_offsets[this->orient].y + ynorth - this->rect.base.y + y_off;
-			this->draw_images.insert(dd);
+			this->draw_images->Add(dd);
 		}
 		vo = vo->next_object;
 	}
@@ -1211,7 +1734,7 @@ void PixelFinder::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_pos,
 		/* Looking for a ride? */
 		DrawData dd[4];
 		int count = DrawRide(slice, voxel_pos.z, this->rect.base.x - xnorth, this->rect.base.y - ynorth,
-				this->orient, number, voxel->GetInstanceData(), dd, nullptr);
+				this->orient, this->sprites, number, voxel->GetInstanceData(), dd, nullptr);
 		for (int i = 0; i < count; i++) {
 			if (!this->found || this->data < dd[i]) {
 				const ImageData *img = dd[i].sprite;
@@ -1299,6 +1822,147 @@ void PixelFinder::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_pos,
 	}
 }
 
+/**
+ * Palette colours of the parts of the cursor test sprites. In #GTP_CURSOR_TEST sprites they denote the north, east, west,
+ * and south corner, in #GTP_CURSOR_EDGE_TEST sprites they denote the north-east, south-east, north-west, and south-west edge.
+ * @ingroup viewport_group
+ */
+static const uint8 _cursor_test_colours[4] = {181, 182, 184, 185};
+
+/**
+ * Find the part of a cursor test sprite denoted by a pixel.
+ * @param pixel Pixel of a cursor test sprite.
+ * @return Index of the colour of the pixel in #_cursor_test_colours, or \c 4 if the pixel does not denote a part.
+ * @ingroup viewport_group
+ */
+static uint GetCursorTestPart(uint32 pixel)
+{
+	uint part = 0;
+	while (part < lengthof(_cursor_test_colours) && pixel != _palette[_cursor_test_colours[part]]) part++;
+	return part;
+}
+
+/**
+ * Make the handle of a sprite found at a pixel of the pick layer.
+ * Layout: 7 bits x, 7 bits y, and 6 bits z of the voxel position, 5 bits kind of sprite (#ClickableSprite), and 3 bits
+ * cursor test part (see #GetCursorTestPart). Since the kind of sprite is never #CS_NONE, a handle is never \c 0.
+ * @param voxel_pos Position of the voxel of the sprite.
+ * @param order Sprite order of the sprite.
+ * @param pixel Colour of the sprite at the pixel.
+ * @return Handle of the sprite.
+ * @ingroup viewport_group
+ */
+static inline uint32 MakePickHandle(const XYZPoint16 &voxel_pos, SpriteOrder order, uint32 pixel)
+{
+	static_assert(WORLD_X_SIZE <= 128 && WORLD_Y_SIZE <= 128 && WORLD_Z_SIZE <= 64, "Voxel positions do not fit in a pick handle.");
+	assert((order & CS_MASK) != CS_NONE);
+
+	return voxel_pos.x | (voxel_pos.y << 7) | (voxel_pos.z << 14) | ((order & CS_MASK) << 20) | (GetCursorTestPart(pixel) << 25);
+}
+
+/**
+ * Constructor of the pick layer block filler.
+ * @param vp %Viewport of the pick layer.
+ * @param allowed Sprite types looking for, must not contain #CS_PERSON.
+ * @param layer Pick layer of the viewport.
+ * @param block Area of the layer to fill.
+ */
+PickCollector::PickCollector(Viewport *vp, ClickableSprite allowed, StaticLayer *layer, const Rectangle32 &block) : VoxelCollector(vp, false)
+{
+	assert((allowed & CS_PERSON) == 0);
+	this->allowed = allowed;
+	this->handles = layer->GetPixel(block.base.x, block.base.y);
+	this->pitch = layer->width;
+	this->keys.resize(block.width * block.height);
+	for (uint y = 0; y < block.height; y++) std::fill_n(this->handles + y * this->pitch, block.width, 0);
+
+	this->SetWindowSize(block.base.x - vp->rect.width / 2, block.base.y - vp->rect.height / 2, block.width, block.height);
+}
+
+PickCollector::~PickCollector()
+{
+}
+
+/**
+ * Find the closest sprites of a voxel, like PixelFinder::CollectVoxel does for a single pixel.
+ * @param voxel %Voxel to examine.
+ * @param voxel_pos World position.
+ * @param xnorth X coordinate of the north corner at the display.
+ * @param ynorth y coordinate of the north corner at the display.
+ */
+void PickCollector::CollectVoxel(const Voxel *voxel, const XYZPoint16 &voxel_pos, int32 xnorth, int32 ynorth)
+{
+	DrawData dd;
+	switch (this->orient) {
+		case 0: dd.level =  voxel_pos.x + voxel_pos.y; break;
+		case 1: dd.level =  voxel_pos.x - voxel_pos.y; break;
+		case 2: dd.level = -voxel_pos.x - voxel_pos.y; break;
+		case 3: dd.level = -voxel_pos.x + voxel_pos.y; break;
+		default: NOT_REACHED();
+	}
+	dd.z_height = voxel_pos.z;
+	dd.sprite = nullptr;
+	dd.base = Point32(0, 0);
+	dd.recolour = nullptr;
+
+	if ((this->allowed & CS_GROUND_EDGE) != 0 && voxel->GetGroundType() != GTP_INVALID) {
+		dd.order = SO_GROUND_EDGE;
+		this->AddSprite(dd, this->sprites->GetSurfaceSprite(GTP_CURSOR_EDGE_TEST, voxel->GetGroundSlope(), this->orient), voxel_pos, xnorth, ynorth);
+	}
+
+	SmallRideInstance number = voxel->GetInstance();
+	if ((this->allowed & CS_RIDE) != 0 && number >= SRI_FULL_RIDES) {
+		DrawData ride_dd[4];
+		int count = DrawRide(dd.level, voxel_pos.z, 0, 0, this->orient, this->sprites, number, voxel->GetInstanceData(), ride_dd, nullptr);
+		for (int i = 0; i < count; i++) this->AddSprite(ride_dd[i], ride_dd[i].sprite, voxel_pos, xnorth, ynorth);
+	} else if ((this->allowed & CS_PATH) != 0 && HasValidPath(voxel)) {
+		uint16 instance_data = voxel->GetInstanceData();
+		dd.order = SO_PATH;
+		this->AddSprite(dd, this->sprites->GetPathSprite(GetPathType(instance_data), GetImplodedPathSlope(instance_data), this->orient), voxel_pos, xnorth, ynorth);
+	} else if ((this->allowed & CS_GROUND) != 0 && voxel->GetGroundType() != GTP_INVALID) {
+		dd.order = SO_GROUND;
+		this->AddSprite(dd, this->sprites->GetSurfaceSprite(GTP_CURSOR_TEST, voxel->GetGroundSlope(), this->orient), voxel_pos, xnorth, ynorth);
+	}
+}
+
+/**
+ * Store a sprite at the pixels of the block where a #PixelFinder would select it.
+ * Only pixels of the area that the #PixelFinder examines for the voxel are considered. A pixel gets the sprite if it is
+ * not transparent there, and if it is drawn after the sprite found so far, that is, the first of the last drawn sprites wins.
+ * @param dd Drawing data of the sprite, the base coordinate is overwritten.
+ * @param spr Sprite to store, may be \c nullptr.
+ * @param voxel_pos World position of the voxel of the sprite.
+ * @param xnorth X coordinate of the north corner of the voxel at the display.
+ * @param ynorth Y coordinate of the north corner of the voxel at the display.
+ */
+void PickCollector::AddSprite(DrawData &dd, const ImageData *spr, const XYZPoint16 &voxel_pos, int32 xnorth, int32 ynorth)
+{
+	if (spr == nullptr) return;
+
+	const int32 half_width = this->tile_width / 2;
+	int32 left   = std::max({this->rect.base.x, xnorth - half_width, xnorth + spr->xoffset});
+	int32 right  = std::min({this->rect.base.x + (int32)this->rect.width, xnorth + half_width, xnorth + spr->xoffset + spr->width});
+	int32 top    = std::max({this->rect.base.y, ynorth - this->tile_height, ynorth + spr->yoffset});
+	int32 bottom = std::min({this->rect.base.y + (int32)this->rect.height, ynorth + half_width + this->tile_height, ynorth + spr->yoffset + spr->height});
+
+	bool edge = dd.order == SO_GROUND_EDGE; // Edge test sprites use colour instead of opacity.
+	for (int32 y = top; y < bottom; y++) {
+		dd.base.y = y - ynorth;
+		uint64 key = GetDrawKey(dd);
+		uint32 *handles = this->handles + (y - this->rect.base.y) * this->pitch;
+		uint64 *keys = this->keys.data() + (y - this->rect.base.y) * this->rect.width;
+		for (int32 x = left; x < right; x++) {
+			int32 index = x - this->rect.base.x;
+			if (handles[index] != 0 && key <= keys[index]) continue;
+
+			uint32 pixel = spr->GetPixel(x - xnorth - spr->xoffset, y - ynorth - spr->yoffset);
+			if (edge ? pixel == 0 : GetA(pixel) == TRANSPARENT) continue;
+			handles[index] = MakePickHandle(voxel_pos, dd.order, pixel);
+			keys[index] = key;
+		}
+	}
+}
+
 /**
  * %Viewport constructor.
  * @param view_pos Pixel position of the center viewpoint of the main display.
@@ -1317,6 +1981,13 @@ Viewport::Viewport(const XYZPoint32 &view_pos) : Window(WC_MAINDISPLAY, ALL_WIND
 	this->additions_enabled = false;
 	this->additions_displayed = false;
 	this->underground_mode = false;
+	this->draw_images = new DrawImages;
+	this->render_lists = new RenderLists;
+	this->static_layer = new StaticLayer;
+	this->pick_layer = new StaticLayer;
+	this->pick_allowed = CS_NONE;
+	this->drawn_shift = GS_INVALID;
+	this->dirty_voxel_set.assign(WORLD_X_SIZE * WORLD_Y_SIZE * WORLD_Z_SIZE, false);
 
 	uint16 width  = _video.GetXSize();
 	uint16 height = _video.GetYSize();
@@ -1328,6 +1999,10 @@ Viewport::Viewport(const XYZPoint32 &view_pos) : Window(WC_MAINDISPLAY, ALL_WIND
 
 Viewport::~Viewport()
 {
+	delete this->draw_images;
+	delete this->render_lists;
+	delete this->static_layer;
+	delete this->pick_layer;
 	_mouse_modes.main_display = nullptr;
 }
 
@@ -1383,36 +2058,325 @@ int32 Viewport::ComputeY(int32 xpos, int32 ypos, int32 zpos)
 	return ComputeYFunction(xpos, ypos, zpos, this->orientation, this->tile_width, this->tile_height);
 }
 
+static const int MIN_BAND_HEIGHT = 32; ///< Minimal height of a band of the viewport that is drawn by a single thread.
+
+/**
+ * Blit sorted sprites into an area.
+ * Large areas are split in horizontal bands that are drawn in parallel by the #_worker_pool. Each band gets its own
+ * clipped rectangle and only draws the sprites that overlap with it. Bands do not overlap, so no locking is needed.
+ * @param cr Area to draw in, its address must be valid.
+ * @param images Sprites to draw, in drawing order.
+ * @param offset Position of the area relative to the base coordinates of the sprites.
+ * @param shift Gradient shift.
+ * @param static_only Only draw the sprites of the static layer, that is, skip the sprites of #IsDynamicSprite.
+ * @ingroup viewport_group
+ */
+static void DrawSprites(const ClippedRectangle &cr, const DrawImages &images, const Point32 &offset, GradientShift shift, bool static_only)
+{
+	static const Recolouring recolour;
+
+	/* Compute the palettes of recoloured 8bpp sprites in advance, the threads may only read them. */
+	for (uint i = 0; i < images.Count(); i++) {
+		const DrawData &dd = images.Get(i);
+		if (!static_only || !IsDynamicSprite(dd)) _render_times.sprites++;
+		if (GB(dd.sprite->flags, IFG_IS_8BPP, 1) != 0 && GB(dd.sprite->flags, IFG_RECOLOUR, 1) != 0) ((dd.recolour == nullptr) ? recolour : *dd.recolour).GetPalette(shift);
+	}
+
+	/* More bands than threads, to balance the load between parts of the display with many and with few sprites. */
+	uint num_bands = Clamp<uint>(cr.height / MIN_BAND_HEIGHT, 1, 4 * _worker_pool.GetThreadCount());
+	int band_height = (cr.height + num_bands - 1) / num_bands;
+	_worker_pool.RunJob(num_bands, [&](uint band) {
+		int top = band * band_height;
+		if (top >= cr.height) return;
+		ClippedRectangle band_rect(cr.address + top * cr.pitch, cr.pitch, cr.width, std::min(band_height, cr.height - top));
+
+		for (uint i = 0; i < images.Count(); i++) {
+			const DrawData &dd = images.Get(i);
+			if (static_only && IsDynamicSprite(dd)) continue;
+
+			Point32 pt(dd.base.x - offset.x, dd.base.y - offset.y - top);
+			int32 spr_top = pt.y + dd.sprite->yoffset;
+			if (spr_top >= band_rect.height || spr_top + dd.sprite->height <= 0) continue; // Sprite is not in this band.
+
+			const Recolouring &rec = (dd.recolour == nullptr) ? recolour : *dd.recolour;
+			_video.BlitImages(band_rect, pt, dd.sprite, 1, 1, rec, shift);
+		}
+	});
+}
+
+/**
+ * Get the gradient shift of the world caused by the weather.
+ * @return Gradient shift to use for drawing the world.
+ */
+static GradientShift GetWeatherShift()
+{
+	return static_cast<GradientShift>(GS_LIGHT - _weather.GetWeatherType());
+}
+
 void Viewport::OnDraw()
 {
+	this->OnDrawArea(this->rect);
+}
+
+Rectangle32 Viewport::OnDrawArea(const Rectangle32 &area)
+{
+	Rectangle32 draw_area(area);
+	draw_area.RestrictTo(this->rect.base.x, this->rect.base.y, this->rect.width, this->rect.height);
+	if (draw_area.width == 0 || draw_area.height == 0) return draw_area;
+
+	this->drawn_shift = GetWeatherShift();
+	this->SyncLayer(this->static_layer, this->drawn_shift);
+	int16 xpos = draw_area.base.x - this->rect.base.x; // Position of the area in the viewport.
+	int16 ypos = draw_area.base.y - this->rect.base.y;
+	this->RenderStaticLayer(Rectangle32(xpos, ypos, draw_area.width, draw_area.height));
+
+	/* Only collect the sprites that may end up in the area being painted. */
+	PhaseTimer timer(RP_COLLECT);
 	SpriteCollector collector(this, _mouse_modes.current->EnableCursors());
-	collector.SetWindowSize(-(int16)this->rect.width / 2, -(int16)this->rect.height / 2, this->rect.width, this->rect.height);
+	collector.SetWindowSize(xpos - this->rect.width / 2, ypos - this->rect.height / 2, draw_area.width, draw_area.height);
 	collector.Collect(this->additions_enabled && this->additions_displayed);
-	static const Recolouring recolour;
-
-	_video.FillRectangle(this->rect, MakeRGBA(0, 0, 0, OPAQUE)); // Black background.
+	timer.Switch(RP_SORT);
+	collector.draw_images->Sort();
+	timer.Switch(RP_BLIT);
 
+	/* Start with the static content of the world. */
 	ClippedRectangle cr = _video.GetClippedRectangle();
-	assert(this->rect.base.x >= 0 && this->rect.base.y >= 0);
-	ClippedRectangle draw_rect(cr, this->rect.base.x, this->rect.base.y, this->rect.width, this->rect.height);
-	_video.SetClippedRectangle(draw_rect);
+	assert(draw_area.base.x >= 0 && draw_area.base.y >= 0);
+	ClippedRectangle draw_rect(cr, draw_area.base.x, draw_area.base.y, draw_area.width, draw_area.height);
+	draw_rect.ValidateAddress();
+	for (int y = 0; y < draw_rect.height; y++) {
+		memcpy(draw_rect.address + y * draw_rect.pitch, this->static_layer->GetPixel(xpos, ypos + y), draw_rect.width * sizeof(uint32));
+	}
+
+	/* Moving objects must be drawn in the right order with the static sprites, repaint the areas around them completely. */
+	static const uint MAX_DYNAMIC_AREAS = 8;
+	static std::vector<Rectangle32> dynamic_areas;
+	dynamic_areas.clear();
+	for (uint i = 0; i < collector.draw_images->Count(); i++) {
+		const DrawData &dd = collector.draw_images->Get(i);
+		if (!IsDynamicSprite(dd)) continue;
+
+		Rectangle32 spr_rect(dd.base.x + dd.sprite->xoffset, dd.base.y + dd.sprite->yoffset, dd.sprite->width, dd.sprite->height);
+		spr_rect.RestrictTo(0, 0, draw_area.width, draw_area.height);
+		if (spr_rect.width == 0 || spr_rect.height == 0) continue;
+
+		bool merged = false;
+		for (Rectangle32 &dyn_area : dynamic_areas) {
+			if (dyn_area.Intersects(spr_rect)) {
+				dyn_area.MergeArea(spr_rect);
+				merged = true;
+				break;
+			}
+		}
+		if (merged) continue;
+		if (dynamic_areas.size() < MAX_DYNAMIC_AREAS) {
+			dynamic_areas.push_back(spr_rect);
+		} else {
+			dynamic_areas.back().MergeArea(spr_rect);
+		}
+	}
 
-	GradientShift gs = static_cast<GradientShift>(GS_LIGHT - _weather.GetWeatherType());
-	for (const auto &iter : collector.draw_images) {
-		const DrawData &dd = iter;
-		const Recolouring &rec = (dd.recolour == nullptr) ? recolour : *dd.recolour;
-		_video.BlitImage(dd.base, dd.sprite, rec, gs);
+	for (Rectangle32 &dyn_area : dynamic_areas) {
+		dyn_area.RestrictTo(0, 0, draw_area.width, draw_area.height);
+		ClippedRectangle dyn_rect(draw_rect, dyn_area.base.x, dyn_area.base.y, dyn_area.width, dyn_area.height);
+		dyn_rect.ValidateAddress();
+		_video.SetClippedRectangle(dyn_rect);
+		_video.FillRectangle(Rectangle32(0, 0, dyn_area.width, dyn_area.height), MakeRGBA(0, 0, 0, OPAQUE)); // Black background.
+		DrawSprites(dyn_rect, *collector.draw_images, dyn_area.base, this->drawn_shift, false);
 	}
 
 	_video.SetClippedRectangle(cr);
+	return draw_area;
 }
 
 /**
- * Mark a voxel as in need of getting painted.
+ * Make a layer of the viewport match the current view of the viewport.
+ * Scrolling keeps the pixels that stay in view, other changes of the view discard the content of the layer.
+ * @param layer Layer to update, the #static_layer or the #pick_layer.
+ * @param shift Gradient shift of the content of the layer.
+ */
+void Viewport::SyncLayer(StaticLayer *layer, GradientShift shift)
+{
+	Point32 origin(this->ComputeX(this->view_pos.x, this->view_pos.y), this->ComputeY(this->view_pos.x, this->view_pos.y, this->view_pos.z));
+
+	if (layer->width != this->rect.width || layer->height != this->rect.height || layer->orient != this->orientation ||
+			layer->tile_width != this->tile_width || layer->underground_mode != this->underground_mode || layer->shift != shift) {
+		layer->Reset(this->rect.width, this->rect.height);
+		layer->orient = this->orientation;
+		layer->tile_width = this->tile_width;
+		layer->underground_mode = this->underground_mode;
+		layer->shift = shift;
+	} else if (layer->origin == origin) {
+		return;
+	} else {
+		layer->Scroll(origin.x - layer->origin.x, origin.y - layer->origin.y);
+	}
+	layer->origin = origin;
+}
+
+/**
+ * Render the out of date parts of the static layer in an area of the viewport.
+ * @param area Area of the viewport that will be painted.
+ * @pre The static layer matches the view, see #SyncLayer.
+ */
+void Viewport::RenderStaticLayer(const Rectangle32 &area)
+{
+	Rectangle32 invalid;
+	if (!this->static_layer->GetInvalidArea(area, &invalid)) return;
+
+	PhaseTimer timer(RP_COLLECT);
+	SpriteCollector collector(this, false);
+	collector.SetWindowSize(invalid.base.x - this->rect.width / 2, invalid.base.y - this->rect.height / 2, invalid.width, invalid.height);
+	collector.Collect(this->additions_enabled && this->additions_displayed);
+	timer.Switch(RP_SORT);
+	collector.draw_images->Sort();
+	timer.Switch(RP_BLIT);
+
+	ClippedRectangle cr = _video.GetClippedRectangle();
+	ClippedRectangle layer_rect(this->static_layer->GetPixel(invalid.base.x, invalid.base.y), this->static_layer->width, invalid.width, invalid.height);
+	_video.SetClippedRectangle(layer_rect);
+	_video.FillRectangle(Rectangle32(0, 0, invalid.width, invalid.height), MakeRGBA(0, 0, 0, OPAQUE)); // Black background.
+	DrawSprites(layer_rect, *collector.draw_images, Point32(0, 0), this->static_layer->shift, true);
+	_video.SetClippedRectangle(cr);
+	this->static_layer->SetValid(invalid);
+}
+
+/**
+ * Notification of a change in the world.
+ * @param code Kind of change, only #CHG_DISPLAY_OLD is handled. It triggers a repaint if the weather changed the lighting.
+ * @param parameter Unused.
+ */
+void Viewport::OnChange(ChangeCode code, uint32 parameter)
+{
+	if (code != CHG_DISPLAY_OLD) return;
+
+	if (GetWeatherShift() != this->drawn_shift) this->MarkDirty();
+}
+
+/**
+ * Mark a voxel as in need of getting painted, after the world in it changed.
+ * Sprites of a voxel, like supports and foundations, may extend into the voxels below it, so the cached static content
+ * of the entire voxel stack is invalidated, like its render list.
  * @param voxel_pos Position of the voxel.
  * @param height Number of voxels to mark above the specified coordinate (\c 0 means inspect the voxel itself).
  */
 void Viewport::MarkVoxelDirty(const XYZPoint16 &voxel_pos, int16 height)
+{
+	Rectangle32 area = this->ComputeVoxelArea(voxel_pos, height);
+	if (IsVoxelstackInsideWorld(voxel_pos.x, voxel_pos.y)) {
+		const VoxelStack *stack = _world.GetStack(voxel_pos.x, voxel_pos.y);
+		if (stack->height > 0) area.MergeArea(this->ComputeVoxelArea(XYZPoint16(voxel_pos.x, voxel_pos.y, stack->base), stack->height));
+	}
+
+	Rectangle32 layer_area(area.base.x - this->rect.base.x, area.base.y - this->rect.base.y, area.width, area.height);
+
+	this->render_lists->Invalidate(voxel_pos.x, voxel_pos.y);
+	this->SyncLayer(this->static_layer, GetWeatherShift());
+	this->static_layer->Invalidate(layer_area);
+	this->SyncLayer(this->pick_layer, GS_NORMAL);
+	this->pick_layer->Invalidate(layer_area);
+	_video.MarkDisplayDirty(area);
+}
+
+/** Mark the entire displayed world as in need of getting painted, after a change that may affect any voxel, like a changed colour of a ride. */
+void Viewport::MarkWorldDirty()
+{
+	this->render_lists->InvalidateAll();
+	this->static_layer->Reset(this->static_layer->width, this->static_layer->height);
+	this->pick_layer->Reset(this->pick_layer->width, this->pick_layer->height);
+	this->MarkDirty();
+}
+
+/**
+ * Get the index of a voxel in a set of voxels of the world.
+ * @param voxel_pos Position of the voxel, must be inside the world.
+ * @return Index of the voxel.
+ */
+static inline uint GetVoxelIndex(const XYZPoint16 &voxel_pos)
+{
+	return voxel_pos.x + (voxel_pos.y + voxel_pos.z * WORLD_Y_SIZE) * WORLD_X_SIZE;
+}
+
+/**
+ * Mark a voxel as in need of getting painted, after only its moving objects or cursors changed.
+ * The static content of the world in the voxel is unchanged.
+ * @param voxel_pos Position of the voxel.
+ * @param height Number of voxels to mark above the specified coordinate (\c 0 means inspect the voxel itself).
+ * @note The area of a single voxel is marked at the display by the next #FlushDirtyVoxels.
+ */
+void Viewport::MarkVoxelDisplayDirty(const XYZPoint16 &voxel_pos, int16 height)
+{
+	if (height > 0 || !IsVoxelInsideWorld(voxel_pos)) {
+		_video.MarkDisplayDirty(this->ComputeVoxelArea(voxel_pos, height));
+		return;
+	}
+
+	/* Moving objects mark their voxel at every step, collect the voxels and compute their areas once for the frame. */
+	uint index = GetVoxelIndex(voxel_pos);
+	if (this->dirty_voxel_set[index]) return;
+	this->dirty_voxel_set[index] = true;
+	this->dirty_voxels.push_back(voxel_pos);
+}
+
+/**
+ * Mark the areas of the voxels collected by #MarkVoxelDisplayDirty as dirty at the display.
+ * Voxels outside the viewport are dropped without inspecting their contents.
+ */
+void Viewport::FlushDirtyVoxels()
+{
+	if (this->dirty_voxels.empty()) return;
+
+	int32 center_x = this->ComputeX(this->view_pos.x, this->view_pos.y) - this->rect.base.x - this->rect.width / 2;
+	int32 center_y = this->ComputeY(this->view_pos.x, this->view_pos.y, this->view_pos.z) - this->rect.base.y - this->rect.height / 2;
+	const Point16 &left = _corner_dxy[RotateCounterClockwise(this->orientation)];
+	const Point16 &right = _corner_dxy[RotateClockwise(this->orientation)];
+	const Point16 &bottom = _corner_dxy[RotateClockwise(RotateClockwise(this->orientation))];
+
+	for (const XYZPoint16 &voxel_pos : this->dirty_voxels) {
+		this->dirty_voxel_set[GetVoxelIndex(voxel_pos)] = false;
+
+		/* The left, right, and bottom corners of the voxel do not depend on its height (see #ComputeVoxelArea). */
+		int32 x = this->ComputeX((voxel_pos.x + left.x) * 256, (voxel_pos.y + left.y) * 256) - center_x;
+		if (x >= this->rect.base.x + (int32)this->rect.width) continue;
+		x = this->ComputeX((voxel_pos.x + right.x) * 256, (voxel_pos.y + right.y) * 256) - center_x;
+		if (x < this->rect.base.x) continue;
+		int32 y = this->ComputeY((voxel_pos.x + bottom.x) * 256, (voxel_pos.y + bottom.y) * 256, voxel_pos.z * 256) - center_y;
+		if (y < this->rect.base.y) continue;
+
+		_video.MarkDisplayDirty(this->ComputeVoxelArea(voxel_pos, 0));
+	}
+	this->dirty_voxels.clear();
+}
+
+/**
+ * Is a voxel (nearly) visible in the viewport? The height of the content of the voxel is assumed to be a single voxel.
+ * @param voxel_pos Position of the voxel.
+ * @param margin Number of pixels around the viewport that are considered visible.
+ * @return Whether the voxel is within the viewport, or within \a margin pixels from it.
+ */
+bool Viewport::IsVoxelVisible(const XYZPoint16 &voxel_pos, int32 margin)
+{
+	int32 center_x = this->ComputeX(this->view_pos.x, this->view_pos.y) - this->rect.width / 2;
+	int32 center_y = this->ComputeY(this->view_pos.x, this->view_pos.y, this->view_pos.z) - this->rect.height / 2;
+
+	const Point16 *pt = &_corner_dxy[RotateCounterClockwise(this->orientation)];
+	if (this->ComputeX((voxel_pos.x + pt->x) * 256, (voxel_pos.y + pt->y) * 256) - center_x >= (int32)this->rect.width + margin) return false;
+	pt = &_corner_dxy[RotateClockwise(this->orientation)];
+	if (this->ComputeX((voxel_pos.x + pt->x) * 256, (voxel_pos.y + pt->y) * 256) - center_x < -margin) return false;
+	pt = &_corner_dxy[this->orientation];
+	if (this->ComputeY((voxel_pos.x + pt->x) * 256, (voxel_pos.y + pt->y) * 256, (voxel_pos.z + 1) * 256) - center_y >= (int32)this->rect.height + margin) return false;
+	pt = &_corner_dxy[RotateClockwise(RotateClockwise(this->orientation))];
+	if (this->ComputeY((voxel_pos.x + pt->x) * 256, (voxel_pos.y + pt->y) * 256, voxel_pos.z * 256) - center_y < -margin) return false;
+	return true;
+}
+
+/**
+ * Compute the area of the screen covered by a voxel.
+ * @param voxel_pos Position of the voxel.
+ * @param height Number of voxels above the specified coordinate (\c 0 means inspect the voxel itself).
+ * @return Area of the screen that displays the voxel.
+ */
+Rectangle32 Viewport::ComputeVoxelArea(const XYZPoint16 &voxel_pos, int16 height)
 {
 	if (height <= 0) {
 		const Voxel *v = _world.GetVoxel(voxel_pos);
@@ -1464,51 +2428,78 @@ void Viewport::MarkVoxelDirty(const XYZPoint16 &voxel_pos, int16 height)
 	assert(d >= rect.base.y);
 	rect.height = d - rect.base.y + 1;
 
-	_video.MarkDisplayDirty(rect);
+	return rect;
+}
+
+/**
+ * Get the handle of the sprite at a pixel of the viewport from the pick layer, filling the block of the pixel if it is out of date.
+ * @param allowed Sprite types looking for, must not contain #CS_PERSON.
+ * @param xpos Horizontal position of the pixel in the viewport.
+ * @param ypos Vertical position of the pixel in the viewport.
+ * @return Handle of the sprite (see #MakePickHandle), or \c 0 if no sprite was found.
+ */
+uint32 Viewport::GetPickHandle(ClickableSprite allowed, int16 xpos, int16 ypos)
+{
+	this->SyncLayer(this->pick_layer, GS_NORMAL);
+	if (allowed != this->pick_allowed) {
+		this->pick_layer->Reset(this->pick_layer->width, this->pick_layer->height);
+		this->pick_allowed = allowed;
+	}
+
+	Rectangle32 block;
+	if (this->pick_layer->GetInvalidArea(Rectangle32(xpos, ypos, 1, 1), &block)) {
+		PickCollector collector(this, allowed, this->pick_layer, block);
+		collector.Collect(false);
+		this->pick_layer->SetValid(block);
+	}
+	return *this->pick_layer->GetPixel(xpos, ypos);
 }
 
 /**
  * Compute position of the mouse cursor, and return the result.
+ * Without persons, the sprite is looked up in the pick layer, which only needs updating after changes in the world.
+ * Persons move all the time, looking for them examines the voxels under the mouse cursor with a #PixelFinder.
  * @param fdata [inout] Parameters and results of the finding process.
  * @return Found type of sprite.
  */
 ClickableSprite Viewport::ComputeCursorPosition(FinderData *fdata)
 {
-	int16 xp = this->mouse_pos.x - this->rect.width / 2;
-	int16 yp = this->mouse_pos.y - this->rect.height / 2;
-	PixelFinder collector(this, fdata);
-	collector.SetWindowSize(xp, yp, 1, 1);
-	collector.Collect(false);
-	if (!collector.found) return CS_NONE;
+	ClickableSprite found;
+	uint part; // Part of the cursor test sprite, see #GetCursorTestPart.
+	if ((fdata->allowed & CS_PERSON) == 0 && this->mouse_pos.x >= 0 && this->mouse_pos.x < (int)this->rect.width &&
+			this->mouse_pos.y >= 0 && this->mouse_pos.y < (int)this->rect.height) {
+		uint32 handle = this->GetPickHandle(fdata->allowed, this->mouse_pos.x, this->mouse_pos.y);
+		fdata->person = nullptr;
+		fdata->ride = INVALID_RIDE_INSTANCE;
+		fdata->voxel_pos = XYZPoint16(GB(handle, 0, 7), GB(handle, 7, 7), GB(handle, 14, 6));
+		if (handle == 0) return CS_NONE;
+
+		found = (ClickableSprite)GB(handle, 20, 5);
+		part = GB(handle, 25, 3);
+		if (found == CS_RIDE) fdata->ride = _world.GetVoxel(fdata->voxel_pos)->GetInstance();
+	} else {
+		int16 xp = this->mouse_pos.x - this->rect.width / 2;
+		int16 yp = this->mouse_pos.y - this->rect.height / 2;
+		PixelFinder collector(this, fdata);
+		collector.SetWindowSize(xp, yp, 1, 1);
+		collector.Collect(false);
+		if (!collector.found) return CS_NONE;
+
+		found = (ClickableSprite)(collector.data.order & CS_MASK);
+		part = GetCursorTestPart(collector.pixel);
+	}
+
+	/* Corners and edges in the order of #_cursor_test_colours. */
+	static const ViewOrientation corners[] = {VOR_NORTH, VOR_EAST, VOR_WEST, VOR_SOUTH};
+	static const TileEdge edges[] = {EDGE_NE, EDGE_SE, EDGE_NW, EDGE_SW};
 
 	fdata->cursor = fdata->select == FW_EDGE ? CUR_TYPE_EDGE_NE : CUR_TYPE_TILE;
-	if (fdata->select == FW_CORNER && (collector.data.order & CS_MASK) == CS_GROUND) {
-		if (collector.pixel == _palette[181]) {
-			fdata->cursor = (CursorType)AddOrientations(VOR_NORTH, this->orientation);
-		} else if (collector.pixel == _palette[182]) {
-			fdata->cursor = (CursorType)AddOrientations(VOR_EAST,  this->orientation);
-		} else if (collector.pixel == _palette[184]) {
-			fdata->cursor = (CursorType)AddOrientations(VOR_WEST,  this->orientation);
-		} else if (collector.pixel == _palette[185]) {
-			fdata->cursor = (CursorType)AddOrientations(VOR_SOUTH, this->orientation);
-		}
+	if (fdata->select == FW_CORNER && found == CS_GROUND && part < lengthof(corners)) {
+		fdata->cursor = (CursorType)AddOrientations(corners[part], this->orientation);
+	} else if (fdata->select == FW_EDGE && found == CS_GROUND_EDGE && part < lengthof(edges)) {
+		fdata->cursor = (CursorType)((edges[part] + (uint8)this->orientation) % 4 + (uint8)CUR_TYPE_EDGE_NE);
 	}
-	else if (fdata->select == FW_EDGE && (collector.data.order & CS_MASK) == CS_GROUND_EDGE) {
-		uint8 base_edge = EDGE_COUNT;
-		if (collector.pixel == _palette[181]) {
-			base_edge = (uint8)EDGE_NE;
-		} else if (collector.pixel == _palette[182]) {
-			base_edge = (uint8)EDGE_SE;
-		} else if (collector.pixel == _palette[184]) {
-			base_edge = (uint8)EDGE_NW;
-		} else if (collector.pixel == _palette[185]) {
-			base_edge = (uint8)EDGE_SW;
-		}
-		if (base_edge < EDGE_COUNT) {
-			fdata->cursor = (CursorType)((base_edge + (uint8)this->orientation) % 4 + (uint8)CUR_TYPE_EDGE_NE);
-		}
-	}
-	return (ClickableSprite)(collector.data.order & CS_MASK);
+	return found;
 }
 
 /**
@@ -1521,10 +2512,30 @@ void Viewport::Rotate(int direction)
 	Point16 pt = this->mouse_pos;
 	this->OnMouseMoveEvent(pt);
 	this->MarkDirty();
+	_guests.OnViewChanged();
 
 	NotifyChange(WC_PATH_BUILDER, ALL_WINDOWS_OF_TYPE, CHG_VIEWPORT_ROTATED, direction);
 }
 
+/**
+ * Zoom in or out, by doubling or halving the size of the tiles.
+ * Zoomed-out views are drawn with the smaller sprites of the sprite manager, so they need less work for the same area of the world.
+ * @param direction Direction of zooming (positive means zooming in).
+ */
+void Viewport::Zoom(int direction)
+{
+	uint16 width = (direction > 0) ? this->tile_width * 2 : this->tile_width / 2;
+	if (_sprite_manager.GetSprites(width) == nullptr) return; // No sprites at that size.
+
+	this->edge_cursor.SetInvalid(); // Its sprite has the old size, the mouse mode sets it again.
+	this->tile_width = width;
+	this->tile_height = width / 4;
+	Point16 pt = this->mouse_pos;
+	this->OnMouseMoveEvent(pt);
+	this->MarkDirty();
+	_guests.OnViewChanged();
+}
+
 /**
  * Compute the horizontal translation in world coordinates of the viewing centre to move it \a dx / \a dy pixels.
  * @param dx Horizontal shift in screen pixels.
@@ -1574,9 +2585,35 @@ void Viewport::MoveViewport(int dx, int dy)
 	int32 new_x = Clamp<int32>(new_xy.x, 0, _world.GetXSize() * 256 - 1);
 	int32 new_y = Clamp<int32>(new_xy.y, 0, _world.GetYSize() * 256 - 1);
 	if (new_x != this->view_pos.x || new_y != this->view_pos.y) {
+		int32 old_x = this->ComputeX(this->view_pos.x, this->view_pos.y);
+		int32 old_y = this->ComputeY(this->view_pos.x, this->view_pos.y, this->view_pos.z);
 		this->view_pos.x = new_x;
 		this->view_pos.y = new_y;
+		this->ScrollDisplay(this->ComputeX(new_x, new_y) - old_x, this->ComputeY(new_x, new_y, this->view_pos.z) - old_y);
+		_guests.OnViewChanged();
+	}
+}
+
+/**
+ * Move the displayed world along with the view, and mark only the parts of the display that need new content as dirty.
+ * @param dx Horizontal movement of the view in pixels.
+ * @param dy Vertical movement of the view in pixels.
+ */
+void Viewport::ScrollDisplay(int dx, int dy)
+{
+	if (!_video.ScrollArea(this->rect, dx, dy)) {
 		this->MarkDirty();
+		return;
+	}
+
+	/* The windows above the viewport moved along with the world, repaint them at both positions. */
+	for (Window *w = this->higher; w != nullptr; w = w->higher) {
+		if (!w->rect.Intersects(this->rect)) continue;
+
+		Rectangle32 moved(w->rect.base.x - dx, w->rect.base.y - dy, w->rect.width, w->rect.height);
+		moved.RestrictTo(this->rect);
+		_video.MarkDisplayDirty(w->rect);
+		_video.MarkDisplayDirty(moved);
 	}
 }
 
@@ -1662,6 +2699,11 @@ bool DefaultMouseMode::EnableCursors()
 	return false;
 }
 
+void DefaultMouseMode::OnMouseWheelEvent(Viewport *vp, int direction)
+{
+	vp->Zoom(direction);
+}
+
 MouseModes::MouseModes()
 {
 	this->main_display = nullptr;
@@ -1691,7 +2733,7 @@ Viewport *GetViewport()
 }
 
 /**
- * Mark a voxel as in need of getting painted.
+ * Mark a voxel as in need of getting painted, after the world in it changed.
  * @param voxel_pos Position of the voxel.
  * @param height Number of voxels to mark above the specified coordinate (\c 0 means inspect the voxel itself).
  */
@@ -1701,6 +2743,42 @@ void MarkVoxelDirty(const XYZPoint16 &voxel_pos, int16 height)
 	if (vp != nullptr) vp->MarkVoxelDirty(voxel_pos, height);
 }
 
+/**
+ * Mark a voxel as in need of getting painted, after only its moving objects changed.
+ * @param voxel_pos Position of the voxel.
+ * @param height Number of voxels to mark above the specified coordinate (\c 0 means inspect the voxel itself).
+ */
+void MarkVoxelDisplayDirty(const XYZPoint16 &voxel_pos, int16 height)
+{
+	Viewport *vp = GetViewport();
+	if (vp != nullptr) vp->MarkVoxelDisplayDirty(voxel_pos, height);
+}
+
+/** Mark the entire displayed world as in need of getting painted, after a change that may affect any voxel. */
+void MarkWorldDirty()
+{
+	Viewport *vp = GetViewport();
+	if (vp != nullptr) vp->MarkWorldDirty();
+}
+
+/**
+ * Is a voxel visible to the user, or nearly visible? Used for deciding how detailed the voxel should be simulated.
+ * @param voxel_pos Position of the voxel.
+ * @return Whether the voxel is within a tile of the main display.
+ */
+bool IsVoxelVisible(const XYZPoint16 &voxel_pos)
+{
+	Viewport *vp = GetViewport();
+	return vp != nullptr && vp->IsVoxelVisible(voxel_pos, vp->tile_width);
+}
+
+/** Mark the areas of the voxels with changed moving objects or cursors as dirty at the display, before repainting it. */
+void FlushDirtyVoxels()
+{
+	Viewport *vp = GetViewport();
+	if (vp != nullptr) vp->FlushDirtyVoxels();
+}
+
 /**
  * Decide the most appropriate mouse mode of the viewport, depending on available windows.
  * @todo Perhaps force a redraw/recompute in some way to ensure the right state is displayed?
@@ -13,8 +13,12 @@
 #define VIEWPORT_H
 
 #include "window.h"
+#include <vector>
 
 class Viewport;
+class DrawImages;
+class StaticLayer;
+class RenderLists;
 class Person;
 class RideInstance;
 
@@ -221,9 +225,16 @@ public:
 	~Viewport();
 
 	void MarkVoxelDirty(const XYZPoint16 &voxel_pos, int16 height = 0);
+	void MarkVoxelDisplayDirty(const XYZPoint16 &voxel_pos, int16 height = 0);
+	void MarkWorldDirty();
+	void FlushDirtyVoxels();
+	bool IsVoxelVisible(const XYZPoint16 &voxel_pos, int32 margin);
 	void OnDraw() override;
+	Rectangle32 OnDrawArea(const Rectangle32 &area) override;
+	void OnChange(ChangeCode code, uint32 parameter) override;
 
 	void Rotate(int direction);
+	void Zoom(int direction);
 	void MoveViewport(int dx, int dy);
 
 	ClickableSprite ComputeCursorPosition(FinderData *fdata);
@@ -253,9 +264,23 @@ public:
 	Point16 mouse_pos;           ///< Last known position of the mouse.
 	bool additions_enabled;      ///< Flashing of world additions is enabled.
 	bool underground_mode;       ///< Whether underground mode is displayed in this viewport.
+	DrawImages *draw_images;     ///< Sprite storage of the viewport, re-used by every #SpriteCollector.
+	RenderLists *render_lists;   ///< Static sprites of the voxel stacks, re-used by every #SpriteCollector.
 
 private:
 	bool additions_displayed;    ///< Additions in #_additions are displayed to the user.
+	GradientShift drawn_shift;   ///< Gradient shift of the last painted world, #GS_INVALID if not painted yet.
+	StaticLayer *static_layer;   ///< Pre-rendered static content of the world in the viewport.
+	StaticLayer *pick_layer;     ///< Handles of the sprites at the pixels of the viewport, for finding the sprite under the mouse cursor.
+	ClickableSprite pick_allowed; ///< Sprite types in the #pick_layer.
+	std::vector<bool> dirty_voxel_set;    ///< Voxels in #dirty_voxels, indexed by #GetVoxelIndex.
+	std::vector<XYZPoint16> dirty_voxels; ///< Voxels with changed moving objects or cursors since the last #FlushDirtyVoxels.
+
+	Rectangle32 ComputeVoxelArea(const XYZPoint16 &voxel_pos, int16 height);
+	void ScrollDisplay(int dx, int dy);
+	void SyncLayer(StaticLayer *layer, GradientShift shift);
+	void RenderStaticLayer(const Rectangle32 &area);
+	uint32 GetPickHandle(ClickableSprite allowed, int16 xpos, int16 ypos);
 
 	void OnMouseMoveEvent(const Point16 &pos) override;
 	WmMouseEvent OnMouseButtonEvent(uint8 state) override;
@@ -309,6 +334,7 @@ public:
 	void ActivateMode(const Point16 &pos) override;
 	void LeaveMode() override;
 	bool EnableCursors() override;
+	void OnMouseWheelEvent(Viewport *vp, int direction) override;
 };
 
 /** All mouse modes. */
@@ -338,5 +364,9 @@ void DisableWorldAdditions();
 Viewport *GetViewport();
 
 void MarkVoxelDirty(const XYZPoint16 &voxel_pos, int16 height = 0);
+void MarkVoxelDisplayDirty(const XYZPoint16 &voxel_pos, int16 height = 0);
+void MarkWorldDirty();
+void FlushDirtyVoxels();
+bool IsVoxelVisible(const XYZPoint16 &voxel_pos);
 
 #endif
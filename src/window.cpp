@@ -221,10 +221,7 @@ Point32 Window::OnInitialPosition()
 	return compute_pos.FindPosition(this);
 }
 
-/**
- * Mark windows as being dirty (needing a repaint).
- * @todo Marking the whole display as needing a repaint is too crude.
- */
+/** Mark windows as being dirty (needing a repaint). */
 void Window::MarkDirty()
 {
 	_video.MarkDisplayDirty(this->rect);
@@ -238,6 +235,18 @@ void Window::OnDraw()
 {
 }
 
+/**
+ * Paint the part of the window that overlaps with an area of the screen that needs repainting.
+ * The default implementation paints the entire window.
+ * @param area Area of the screen that needs repainting, overlaps with the window.
+ * @return Area of the screen that has been painted.
+ */
+Rectangle32 Window::OnDrawArea(const Rectangle32 &area)
+{
+	this->OnDraw();
+	return this->rect;
+}
+
 /**
  * Mouse moved to new position.
  * @param pos New position.
@@ -367,8 +376,10 @@ StringID GuiWindow::TranslateStringNumber(StringID str_id) const
 
 void GuiWindow::ResetSize()
 {
+	this->MarkDirty(); // Old area of the window.
 	this->tree->SetupMinimalSize(this, this->widgets);
 	this->rect = Rectangle32(this->rect.base.x, this->rect.base.y, this->tree->min_x, this->tree->min_y);
+	this->MarkDirty();
 
 	Rectangle16 min_rect(0, 0, this->tree->min_x, this->tree->min_y);
 	this->tree->SetSmallestSizePosition(min_rect);
@@ -989,30 +1000,36 @@ bool WindowManager::KeyEvent(WmKeyCode key_code, const uint8 *symbol)
 }
 
 /**
- * Redraw (parts of) the windows.
- * @todo [medium/difficult] Do this much less stupid.
+ * Redraw the parts of the windows that are out of date.
+ * Windows are painted from bottom to top. A window that paints more than the area being repainted (for example, the
+ * whole window) extends the area, such that all windows above it that overlap are painted as well.
  * @ingroup window_group
  */
 void UpdateWindows()
 {
 	if (!_video.DisplayNeedsRepaint()) return;
 
-	/* Until the entire background is covered by the main display, clean the entire display to ensure deleted
-	 * windows truly disappear (even if there is no other window behind it).
-	 */
-	Rectangle32 rect(0, 0, _video.GetXSize(), _video.GetYSize());
-	_video.FillRectangle(rect, MakeRGBA(0, 0, 0, OPAQUE));
+	static std::vector<Rectangle32> areas; ///< Areas being repainted, kept to avoid allocating memory for every repaint.
+	_video.GetRepaintAreas(&areas);
 
-	Window *w = _window_manager.bottom;
-	while (w != nullptr) {
-		w->OnDraw();
-		w = w->higher;
+	for (Rectangle32 &area : areas) {
+		/* Clean the area first to ensure deleted windows truly disappear (even if there is no other window behind it). */
+		_video.FillRectangle(area, MakeRGBA(0, 0, 0, OPAQUE));
+
+		Window *w = _window_manager.bottom;
+		while (w != nullptr) {
+			if (w->rect.Intersects(area)) {
+				Rectangle32 painted = w->OnDrawArea(area);
+				if (!area.Contains(painted)) area.MergeArea(painted);
+			}
+			w = w->higher;
+		}
 	}
 
-	_video.FinishRepaint();
+	_video.FinishRepaint(areas);
 }
 
-/** A tick has passed, update whatever must be updated. */
+/** A tick has passed, update whatever must be updated. Repainting is done separately, see #UpdateWindows. */
 void WindowManager::Tick()
 {
 	Window *w = _window_manager.top;
@@ -1023,8 +1040,6 @@ void WindowManager::Tick()
 		}
 		w = w->lower;
 	}
-
-	UpdateWindows();
 }
 
 /**
@@ -54,6 +54,7 @@ enum WindowTypes {
 	WC_FINANCES,        ///< Finance management window.
 	WC_SETTING,         ///< Setting window.
 	WC_DROPDOWN,        ///< Dropdown window.
+	WC_PERFORMANCE,     ///< Performance window.
 
 	WC_NONE,            ///< Invalid window type.
 };
@@ -157,6 +158,7 @@ public:
 	void MarkDirty();
 
 	virtual void OnDraw();
+	virtual Rectangle32 OnDrawArea(const Rectangle32 &area);
 	virtual void OnMouseMoveEvent(const Point16 &pos);
 	virtual WmMouseEvent OnMouseButtonEvent(uint8 state);
 	virtual void OnMouseWheelEvent(int direction);
@@ -384,5 +386,6 @@ void ShowCoasterManagementGui(RideInstance *coaster);
 void ShowCoasterBuildGui(CoasterInstance *coaster);
 void ShowErrorMessage(StringID strid);
 void ShowSettingGui();
+void TogglePerformanceGui();
 
 #endif
@@ -0,0 +1,134 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file worker_pool.cpp Pool of threads for executing work in parallel. */
+
+#include "stdafx.h"
+#include "worker_pool.h"
+
+WorkerPool _worker_pool; ///< Worker threads of the program.
+
+static const uint MAX_WORKERS = 15; ///< Maximal number of worker threads.
+
+WorkerPool::WorkerPool()
+{
+	this->task = nullptr;
+	this->task_count = 0;
+	this->next_task = 0;
+	this->done_tasks = 0;
+	this->active_workers = 0;
+	this->generation = 0;
+	this->quit = false;
+}
+
+WorkerPool::~WorkerPool()
+{
+	this->Shutdown();
+}
+
+/**
+ * Start the worker threads.
+ * @param num_workers Number of worker threads to start in addition to the main thread, \c 0 means one less than the number of CPU cores.
+ */
+void WorkerPool::Initialize(uint num_workers)
+{
+	assert(this->workers.empty());
+
+	if (num_workers == 0) {
+		uint num_cores = std::thread::hardware_concurrency();
+		num_workers = (num_cores > 1) ? num_cores - 1 : 0;
+	}
+	num_workers = std::min(num_workers, MAX_WORKERS);
+
+	this->quit = false;
+	for (uint i = 0; i < num_workers; i++) this->workers.emplace_back(&WorkerPool::WorkerMain, this);
+}
+
+/** Stop the worker threads. Jobs are executed by the calling thread afterwards. */
+void WorkerPool::Shutdown()
+{
+	if (this->workers.empty()) return;
+
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->quit = true;
+	}
+	this->start_cond.notify_all();
+	for (std::thread &worker : this->workers) worker.join();
+	this->workers.clear();
+}
+
+/**
+ * Execute a job, and wait until all its tasks are done.
+ * @param count Number of tasks of the job.
+ * @param task Function executing a task, its parameter is the index of the task.
+ * @note Must be called from the main thread only.
+ */
+void WorkerPool::RunJob(uint count, const std::function<void(uint)> &task)
+{
+	if (count == 0) return;
+	if (count == 1 || this->workers.empty()) {
+		for (uint i = 0; i < count; i++) task(i);
+		return;
+	}
+
+	{
+		/* Workers may still be leaving the previous job, wait for them before changing the job. */
+		std::unique_lock<std::mutex> guard(this->lock);
+		this->done_cond.wait(guard, [this]{ return this->active_workers == 0; });
+
+		this->task = &task;
+		this->task_count = count;
+		this->next_task = 0;
+		this->done_tasks = 0;
+		this->generation++;
+	}
+	this->start_cond.notify_all();
+
+	this->RunTasks();
+
+	std::unique_lock<std::mutex> guard(this->lock);
+	this->done_cond.wait(guard, [this]{ return this->done_tasks == this->task_count; });
+}
+
+/** Execute tasks of the current job until all tasks have been taken. */
+void WorkerPool::RunTasks()
+{
+	for (;;) {
+		uint index = this->next_task++;
+		if (index >= this->task_count) return;
+
+		(*this->task)(index);
+		if (++this->done_tasks == this->task_count) {
+			std::lock_guard<std::mutex> guard(this->lock);
+			this->done_cond.notify_all();
+		}
+	}
+}
+
+/** Main function of a worker thread. */
+void WorkerPool::WorkerMain()
+{
+	uint32 seen_generation = 0;
+	std::unique_lock<std::mutex> guard(this->lock);
+	for (;;) {
+		this->start_cond.wait(guard, [this, seen_generation]{ return this->quit || this->generation != seen_generation; });
+		if (this->quit) return;
+
+		seen_generation = this->generation;
+		this->active_workers++;
+		guard.unlock();
+
+		this->RunTasks();
+
+		guard.lock();
+		this->active_workers--;
+		if (this->active_workers == 0) this->done_cond.notify_all();
+	}
+}
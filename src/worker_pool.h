@@ -0,0 +1,64 @@
+/* $Id$ */
+
+/*
+ * This file is part of FreeRCT.
+ * FreeRCT is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * FreeRCT is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with FreeRCT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file worker_pool.h Pool of threads for executing work in parallel. */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Pool of worker threads that execute the tasks of a job in parallel with the main thread.
+ * A job consists of a number of independent tasks, identified by their index. Tasks may be executed in any order
+ * and by any thread, they must not touch data of other tasks.
+ */
+class WorkerPool {
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	void Initialize(uint num_workers);
+	void Shutdown();
+	void RunJob(uint count, const std::function<void(uint)> &task);
+
+	/**
+	 * Get the number of threads that execute the tasks of a job, including the calling thread.
+	 * @return Number of threads working on a job.
+	 */
+	inline uint GetThreadCount() const
+	{
+		return this->workers.size() + 1;
+	}
+
+private:
+	void WorkerMain();
+	void RunTasks();
+
+	std::vector<std::thread> workers;         ///< Worker threads.
+	std::mutex lock;                          ///< Lock protecting the job administration.
+	std::condition_variable start_cond;       ///< Signal to the workers that a new job is available.
+	std::condition_variable done_cond;        ///< Signal to the main thread that a job is done, or a worker became idle.
+	const std::function<void(uint)> *task;    ///< Task function of the current job.
+	uint task_count;                          ///< Number of tasks of the current job.
+	std::atomic<uint> next_task;              ///< Index of the next task to execute.
+	std::atomic<uint> done_tasks;             ///< Number of finished tasks.
+	uint active_workers;                      ///< Number of workers executing tasks.
+	uint32 generation;                        ///< Sequence number of the current job.
+	bool quit;                                ///< Workers should stop.
+};
+
+extern WorkerPool _worker_pool;
+
+#endif